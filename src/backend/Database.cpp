@@ -5,9 +5,11 @@
 #include <vector>
 
 #include "Database.h"
+#include "../io/FileManager.h"
 
 Database::Database() {
     ready = false;
+    readOnly = false;
     for (auto &tb : table) {
         tb = nullptr;
     }
@@ -21,23 +23,28 @@ bool Database::isOpen() {
     return ready;
 }
 
+bool Database::isReadOnly() {
+    return readOnly;
+}
+
 std::string Database::getDBName() {
     return dbName;
 }
 
 void Database::close() {
     assert(ready);
-    FILE *file = fopen((dbName + ".db").c_str(), "w");
-    fprintf(file, "%zu\n", tableSize);
+    FILE *file = readOnly ? nullptr : fopen((dbName + ".db").c_str(), "w");
+    if (file) fprintf(file, "%zu\n", tableSize);
     for (size_t i = 0; i < tableSize; i++) {
         table[i]->close();
         delete table[i];
         table[i] = nullptr;
-        fprintf(file, "%s\n", tableName[i].c_str());
+        if (file) fprintf(file, "%s\n", tableName[i].c_str());
     }
     tableSize = 0;
-    fclose(file);
+    if (file) fclose(file);
     ready = false;
+    readOnly = false;
 }
 
 void Database::drop() {
@@ -47,22 +54,35 @@ void Database::drop() {
         table[i]->drop();
         delete table[i];
         table[i] = nullptr;
-        remove((dbName + "." + tableName[i] + ".table").c_str());
+        FileManager::removeFile((dbName + "." + tableName[i] + ".table").c_str());
     }
     ready = false;
+    readOnly = false;
     tableSize = 0;
 }
 
-void Database::open(const std::string &name) {
+void Database::open(const std::string &name, bool readOnly) {
     assert(!ready);
     dbName = name;
+    this->readOnly = readOnly;
     std::ifstream fin((name + ".db").c_str());
     fin >> tableSize;
     for (size_t i = 0; i < tableSize; i++) {
         fin >> tableName[i];
         assert(table[i] == nullptr);
         table[i] = new Table();
-        table[i]->open((name + "." + tableName[i] + ".table").c_str());
+        try {
+            table[i]->open((name + "." + tableName[i] + ".table").c_str(), readOnly);
+        } catch (...) {
+            // the database stays closed, without the tables opened so far
+            for (size_t j = 0; j <= i; j++) {
+                if (j < i) table[j]->close();
+                delete table[j];
+                table[j] = nullptr;
+            }
+            tableSize = 0;
+            throw;
+        }
     }
     ready = true;
 }
@@ -73,6 +93,7 @@ void Database::create(const std::string &name) {
     fclose(file);
     assert(ready == 0);
     ready = true;
+    readOnly = false;
     tableSize = 0;
     dbName = name;
 }
@@ -99,12 +120,12 @@ Table *Database::getTableById(const size_t id) {
     else return nullptr;
 }
 
-Table *Database::createTable(const std::string &name) {
-    assert(ready);
+Table *Database::createTable(const std::string &name, TableLayout layout, bool compressed) {
+    assert(ready && !readOnly);
     tableName[tableSize] = name;
     assert(table[tableSize] == nullptr);
     table[tableSize] = new Table();
-    table[tableSize]->create((dbName + "." + name + ".table").c_str());
+    table[tableSize]->create((dbName + "." + name + ".table").c_str(), layout, compressed);
     tableSize++;
     return table[tableSize - 1];
 }
@@ -127,7 +148,7 @@ void Database::dropTableByName(const std::string &name) {
     tableName[p] = tableName[tableSize - 1];
     tableName[tableSize - 1] = "";
     tableSize--;
-    remove((dbName + "." + name + ".table").c_str());
+    FileManager::removeFile((dbName + "." + name + ".table").c_str());
 }
 
 std::vector<std::string> Database::getTableNames() {
@@ -136,4 +157,4 @@ std::vector<std::string> Database::getTableNames() {
         name.push_back(tableName[i]);
     }
     return name;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -8,7 +8,7 @@
 #include "Table.h"
 
 class Database {
-    bool ready;
+    bool ready, readOnly;
     std::string tableName[MAX_TABLE_SIZE];
     size_t tableSize;
     Table *table[MAX_TABLE_SIZE];
@@ -21,13 +21,16 @@ public:
 
     bool isOpen();
 
+    bool isReadOnly();
+
     std::string getDBName();
 
     void close();
 
     void drop();
 
-    void open(const std::string &name);
+    // the tables of a read-only database are scanned from an mmap of their files
+    void open(const std::string &name, bool readOnly = false);
 
     void create(const std::string &name);
 
@@ -38,7 +41,7 @@ public:
 
     Table *getTableById(const size_t id);
 
-    Table *createTable(const std::string &name);
+    Table *createTable(const std::string &name, TableLayout layout = TL_ROW, bool compressed = false);
 
     void dropTableByName(const std::string &name);
 
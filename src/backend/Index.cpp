@@ -1,6 +1,8 @@
 //
 // Created by Harry Chen on 2017/11/20.
 //
+#include <algorithm>
+#include <iterator>
 #include <string>
 #include <sstream>
 #include <fstream>
@@ -42,6 +44,21 @@ void Index::insert(const IndexKey &key) {
     list.insert(key);
 }
 
+void Index::insertBatch(std::vector<IndexKey> &keys) {
+    std::sort(keys.begin(), keys.end());
+    if (keys.size() < list.size() / 8) {
+        // cheaper than rebuilding a large tree
+        for (const auto &key : keys) insert(key);
+        return;
+    }
+    std::vector<IndexKey> all;
+    all.reserve(list.size() + keys.size());
+    std::merge(list.begin(), list.end(), keys.begin(), keys.end(), std::back_inserter(all));
+    list.clear();
+    list.bulk_load(all.begin(), all.end());
+    iter = list.begin();
+}
+
 int Index::begin() {
     iter = list.begin();
     if (iter == list.end()) return -1;
@@ -2,13 +2,14 @@
 #define __INDEX_H__
 
 #include "stx/btree_set.h"
+#include <vector>
 
 // set rid to -1 when using tempBuffer in the table to compare.
 class IndexKey {
     int permID;
     int rid;
     int fastCmp;
-    int8_t col;
+    int16_t col;
     bool isNull;
 public:
     IndexKey() = default;
@@ -48,6 +49,9 @@ public:
 
     void insert(const IndexKey &key);
 
+    // sort the keys and merge them into the tree, bulk-loaded again
+    void insertBatch(std::vector<IndexKey> &keys);
+
     int begin();
 
     int end();
@@ -1,6 +1,8 @@
 //
 // Created by Harry Chen on 2017/11/20.
 //
+#include <algorithm>
+#include <cstddef>
 #include <cstring>
 #include <string>
 #include <sstream>
@@ -8,6 +10,7 @@
 
 #include "../io/FileManager.h"
 #include "../io/BufPageManager.h"
+#include "../io/PageGuard.h"
 #include "RegisterManager.h"
 
 bool operator<(const IndexKey &a, const IndexKey &b) {
@@ -43,28 +46,50 @@ bool operator<(const IndexKey &a, const IndexKey &b) {
             assert(0);
     }
 
-    char *x = tab->select(a.rid, a.col);
-    char *y = tab->select(b.rid, b.col);
+    // the value of `a` is copied first, the page of `b` may replace its page
+    // in the buffer
+    ColumnView x = tab->view(a.rid, a.col);
     int res = 0;
     switch (tp) {
-        case CT_VARCHAR:
-            res = compareVarcharSgn(x, y);
+        case CT_VARCHAR: {
+            char copy[PAGE_SIZE];
+            memcpy(copy, x.data, (size_t) x.len + 1);
+            res = sgn(strcmp(copy, tab->view(b.rid, b.col).data));
             break;
-        case CT_FLOAT:
-            res = compareFloatSgn(*(float *) x, *(float *) y);
+        }
+        case CT_FLOAT: {
+            float fx, fy;
+            memcpy(&fx, x.data, 4);
+            memcpy(&fy, tab->view(b.rid, b.col).data, 4);
+            res = compareFloatSgn(fx, fy);
+            break;
+        }
         default:
             assert(0);
     }
-    delete[] x;
-    delete[] y;
     if (res < 0) return true;
     if (res > 0) return false;
     return a.rid < b.rid;
 }
 
+// the bytes of the catalog in each of its pages
+static const int CATALOG_PAGE_BYTES = PAGE_SIZE - PAGE_CHECKSUM_SIZE;
+
+// bit `col` of the null bitmap starting a record
+static bool notNullBit(const char *record, int col) {
+    return (record[col / 8] >> (col % 8)) & 1;
+}
+
+static void setNotNullBit(char *record, int col, bool notNull) {
+    if (notNull) {
+        record[col / 8] |= (char) (1 << (col % 8));
+    } else {
+        record[col / 8] &= (char) ~(1 << (col % 8));
+    }
+}
+
 void Table::initTempRecord() {
-    unsigned int &notNull = *(unsigned int *) buf;
-    notNull = 0;
+    memset(buf, 0, (size_t) head.columnOffset[0]);
     for (int i = 0; i < head.columnTot; i++) {
         if (head.defaultOffset[i] != -1) {
             switch (head.columnType[i]) {
@@ -79,42 +104,296 @@ void Table::initTempRecord() {
                 default:
                     assert(false);
             }
-            notNull |= (1u << i);
+            setNotNullBit(buf, i, true);
         }
     }
 }
 
+static SlottedPageHead *slottedHead(char *page) {
+    return (SlottedPageHead *) page;
+}
+
+static Slot *slotAt(char *page, int slot) {
+    return (Slot *) (page + sizeof(SlottedPageHead)) + slot;
+}
+
+// an empty slot of the page, slotTot if there is none
+static int emptySlot(char *page) {
+    SlottedPageHead *h = slottedHead(page);
+    for (int i = 0; i < h->slotTot; i++) {
+        if (slotAt(page, i)->offset == 0) return i;
+    }
+    return h->slotTot;
+}
+
+// bytes free for the record of `slot` once the page is compacted
+static int slottedRoom(char *page, int slot) {
+    SlottedPageHead *h = slottedHead(page);
+    int slots = std::max((int) h->slotTot, slot + 1);
+    return SLOTTED_PAGE_END - (int) sizeof(SlottedPageHead) - slots * (int) sizeof(Slot) - h->usedBytes;
+}
+
+// move the records to the end of the page, leaving no holes
+static void compactSlotted(char *page) {
+    char copy[PAGE_SIZE];
+    memcpy(copy, page, PAGE_SIZE);
+    SlottedPageHead *h = slottedHead(page);
+    int end = SLOTTED_PAGE_END;
+    for (int i = 0; i < h->slotTot; i++) {
+        Slot *s = slotAt(page, i);
+        if (s->offset == 0) continue;
+        int len = s->len & SLOT_LEN_MASK;
+        end -= len;
+        memcpy(page + end, copy + s->offset, len);
+        s->offset = (uint16_t) end;
+    }
+    h->freeEnd = (uint16_t) end;
+}
+
+// take `len` bytes for the empty `slot`, which may be slotTot
+static char *placeSlotted(char *page, int slot, int len, int flags) {
+    assert(slottedRoom(page, slot) >= len);
+    SlottedPageHead *h = slottedHead(page);
+    int slots = std::max((int) h->slotTot, slot + 1);
+    if (h->freeEnd - len < (int) sizeof(SlottedPageHead) + slots * (int) sizeof(Slot)) {
+        compactSlotted(page);
+    }
+    h->slotTot = (uint16_t) slots;
+    Slot *s = slotAt(page, slot);
+    h->freeEnd -= len;
+    h->usedBytes += len;
+    s->offset = h->freeEnd;
+    s->len = (uint16_t) (len | flags);
+    return page + s->offset;
+}
+
+// empty the slot but keep it in the directory
+static void clearSlot(char *page, int slot) {
+    SlottedPageHead *h = slottedHead(page);
+    Slot *s = slotAt(page, slot);
+    int len = s->len & SLOT_LEN_MASK;
+    if (s->offset == h->freeEnd) h->freeEnd += len;
+    h->usedBytes -= len;
+    s->offset = s->len = 0;
+}
+
+static void freeSlot(char *page, int slot) {
+    clearSlot(page, slot);
+    SlottedPageHead *h = slottedHead(page);
+    while (h->slotTot > 0 && slotAt(page, h->slotTot - 1)->offset == 0) {
+        h->slotTot--;
+    }
+}
+
 void Table::allocPage() {
-    auto index = BufPageManager::getInstance().allocPage(fileID, head.pageTot);
-    auto buf = BufPageManager::getInstance().access(index);
-    auto n = (PAGE_SIZE - PAGE_FOOTER_SIZE) / head.recordByte;
-    n = (n < MAX_REC_PER_PAGE) ? n : MAX_REC_PER_PAGE;
-    for (int i = 0, p = 0; i < n; i++, p += head.recordByte) {
-        unsigned int &ptr = *(unsigned int *) (buf + p);
-        ptr = head.nextAvail;
-        head.nextAvail = (unsigned int) head.pageTot * PAGE_SIZE + p;
+    if (isMapPage(head.pageTot)) {
+        PageGuard fsm = PageGuard::alloc(fileID, head.pageTot);
+        memset(fsm.data(), 0, PAGE_SIZE);
+        fsm.markDirty();
+        head.pageTot++;
+    }
+    int pageID = head.pageTot++;
+    PageGuard page = PageGuard::alloc(fileID, pageID);
+    auto buf = page.data();
+    if (head.layout == TL_SLOTTED) {
+        SlottedPageHead *h = slottedHead(buf);
+        h->slotTot = h->usedBytes = h->reserved = 0;
+        h->freeEnd = SLOTTED_PAGE_END;
+    } else {
+        memset(buf + PAGE_SIZE - PAGE_CHECKSUM_SIZE - footerBytes(), 0, (size_t) footerBytes());
+    }
+    page.markDirty();
+    updateFreeSpace(pageID, buf);
+}
+
+bool Table::isMapPage(int pageID) {
+    return pageID >= head.catalogPages && (pageID - head.catalogPages) % (FSM_SPAN + 1) == 0;
+}
+
+int Table::mapPageOf(int pageID) {
+    return pageID - (pageID - head.catalogPages) % (FSM_SPAN + 1);
+}
+
+int Table::firstDataPage() {
+    return head.catalogPages + 1;
+}
+
+int Table::freeSpace(char *page) {
+    int room;
+    if (head.layout == TL_SLOTTED) {
+        room = std::max(slottedRoom(page, emptySlot(page)), 0) / FSM_UNIT;
+    } else {
+        int n = recordsPerPage();
+        room = n;
+        auto footer = (const unsigned int *) (page + PAGE_SIZE - PAGE_CHECKSUM_SIZE - footerBytes());
+        for (int i = 0; i < n; i += 32) {
+            room -= __builtin_popcount(footer[i / 32]);
+        }
+    }
+    return std::min(room, 255);
+}
+
+void Table::updateFreeSpace(int pageID, char *page) {
+    int room = freeSpace(page);
+    int mapID = mapPageOf(pageID);
+    PageGuard fsm(fileID, mapID);
+    auto entry = (unsigned char *) fsm.data() + (pageID - mapID - 1);
+    if (*entry != room) {
+        *entry = (unsigned char) room;
+        fsm.markDirty();
+    }
+    if (room > 0 && pageID < fsmHint) fsmHint = pageID;
+}
+
+bool Table::isEmptyPage(char *page) {
+    if (head.layout == TL_SLOTTED) return slottedHead(page)->slotTot == 0;
+    auto footer = (const unsigned int *) (page + PAGE_SIZE - PAGE_CHECKSUM_SIZE - footerBytes());
+    for (int i = 0; i < footerBytes() / 4; i++) {
+        if (footer[i]) return false;
+    }
+    return true;
+}
+
+int Table::findFreePage(int need) {
+    if (batching) {
+        // the caller looks at the page itself, the map is updated at endBatch
+        return head.pageTot - 1 >= firstDataPage() ? head.pageTot - 1 : -1;
+    }
+    if (lastPage >= firstDataPage() && lastPage < head.pageTot) {
+        int mapID = mapPageOf(lastPage);
+        if (((unsigned char *) readPage(mapID))[lastPage - mapID - 1] >= need) return lastPage;
+    }
+    bool full = true;
+    int pageID = std::max(fsmHint, firstDataPage());
+    while (pageID < head.pageTot) {
+        if (isMapPage(pageID)) pageID++;
+        int mapID = mapPageOf(pageID);
+        auto entries = (const unsigned char *) readPage(mapID);
+        int end = std::min(mapID + 1 + FSM_SPAN, head.pageTot);
+        for (; pageID < end; pageID++) {
+            int room = entries[pageID - mapID - 1];
+            if (room > 0 && full) {
+                fsmHint = pageID;
+                full = false;
+            }
+            if (room >= need) return pageID;
+        }
+    }
+    if (full) fsmHint = head.pageTot;
+    return -1;
+}
+
+int Table::freeRecord(const char *page) {
+    int n = recordsPerPage();
+    auto footer = (const unsigned int *) (page + PAGE_SIZE - PAGE_CHECKSUM_SIZE - footerBytes());
+    for (int i = 0; i < n; i += 32) {
+        unsigned int used = footer[i / 32];
+        if (~used) {
+            int idx = i + __builtin_ctz(~used);
+            return idx < n ? idx : -1;
+        }
+    }
+    return -1;
+}
+
+// records of `recordByte` bytes in a TL_ROW or TL_PAX page
+static int fitRecords(int recordByte) {
+    // a record and a bit each, then the footer is rounded up to words
+    const int room = PAGE_SIZE - PAGE_CHECKSUM_SIZE;
+    int n = room * 8 / (recordByte * 8 + 1);
+    while (n * recordByte + (n + 31) / 32 * 4 > room) n--;
+    return n;
+}
+
+int Table::recordsPerPage() {
+    return perPage;
+}
+
+int Table::nextUsedRecord(const char *page, int idx) {
+    auto footer = (const unsigned int *) (page + PAGE_SIZE - PAGE_CHECKSUM_SIZE - footerBytes());
+    // the bits after the last record are never set
+    for (int i = idx / 32; i * 32 < perPage; i++) {
+        unsigned int used = footer[i];
+        if (i == idx / 32) used &= ~0u << (idx % 32);
+        if (used) return i * 32 + __builtin_ctz(used);
+    }
+    return -1;
+}
+
+int Table::footerBytes() {
+    return (perPage + 31) / 32 * 4;
+}
+
+int Table::columnBytes(int col) {
+    int end = col + 1 < head.columnTot ? head.columnOffset[col + 1] : head.recordByte;
+    return end - head.columnOffset[col];
+}
+
+char *Table::fieldPtr(char *page, int idx, int offset, int width) {
+    if (head.layout == TL_PAX) return page + recordsPerPage() * offset + idx * width;
+    return page + idx * head.recordByte + offset;
+}
+
+void Table::loadRecord(char *page, int idx, char *record) {
+    if (head.layout != TL_PAX) {
+        memcpy(record, page + idx * head.recordByte, (size_t) head.recordByte);
+        return;
+    }
+    int nullBytes = head.columnOffset[0];
+    memcpy(record, fieldPtr(page, idx, 0, nullBytes), (size_t) nullBytes);
+    for (int i = 0; i < head.columnTot; i++) {
+        int width = columnBytes(i);
+        memcpy(record + head.columnOffset[i], fieldPtr(page, idx, head.columnOffset[i], width), width);
+    }
+}
+
+void Table::storeRecord(char *page, int idx, const char *record) {
+    if (head.layout != TL_PAX) {
+        memcpy(page + idx * head.recordByte, record, (size_t) head.recordByte);
+        return;
+    }
+    int nullBytes = head.columnOffset[0];
+    memcpy(fieldPtr(page, idx, 0, nullBytes), record, (size_t) nullBytes);
+    for (int i = 0; i < head.columnTot; i++) {
+        int width = columnBytes(i);
+        memcpy(fieldPtr(page, idx, head.columnOffset[i], width), record + head.columnOffset[i], width);
     }
-    memset(buf + PAGE_SIZE - PAGE_FOOTER_SIZE, 0, PAGE_FOOTER_SIZE);
-    BufPageManager::getInstance().markDirty(index);
-    head.pageTot++;
 }
 
 void Table::inverseFooter(const char *page, int idx) {
     int u = idx / 32;
     int v = idx % 32;
-    unsigned int &tmp = *(unsigned int *) (page + PAGE_SIZE - PAGE_FOOTER_SIZE + u * 4);
+    unsigned int &tmp = *(unsigned int *) (page + PAGE_SIZE - PAGE_CHECKSUM_SIZE - footerBytes() + u * 4);
     tmp ^= (1u << v);
 }
 
 int Table::getFooter(const char *page, int idx) {
     int u = idx / 32;
     int v = idx % 32;
-    unsigned int tmp = *(unsigned int *) (page + PAGE_SIZE - PAGE_FOOTER_SIZE + u * 4);
+    unsigned int tmp = *(unsigned int *) (page + PAGE_SIZE - PAGE_CHECKSUM_SIZE - footerBytes() + u * 4);
     return (tmp >> v) & 1;
 }
 
+char *Table::readPage(int pageID) {
+    if (map) {
+        char *page = map + (size_t) pageID * PAGE_SIZE;
+        // a mapped page is verified the first time it is read
+        if (!mapVerified[pageID]) {
+            BufPageManager::getInstance().verifyPage(fileID, pageID, page);
+            mapVerified[pageID] = true;
+        }
+        return page;
+    }
+    int index = BufPageManager::getInstance().getPage(fileID, pageID);
+    return BufPageManager::getInstance().access(index);
+}
+
 Table::Table() {
     ready = false;
+    readOnly = false;
+    batching = false;
+    map = nullptr;
+    rowBuf = nullptr;
 }
 
 Table::~Table() {
@@ -126,9 +405,26 @@ std::string Table::getTableName() {
     return tableName;
 }
 
+int Table::getFileID() {
+    assert(ready);
+    return fileID;
+}
+
+bool Table::isReadOnly() {
+    return readOnly;
+}
+
+TableLayout Table::getLayout() {
+    return (TableLayout) head.layout;
+}
+
+bool Table::isCompressed() {
+    return BufPageManager::getFileManager().isCompressed(fileID);
+}
+
 void Table::printSchema() {
     for (int i = 1; i < head.columnTot; i++) {
-        printf("%s", head.columnName[i]);
+        printf("%s", head.columnName[i].c_str());
         switch (head.columnType[i]) {
             case CT_INT:
                 printf(" INT(%d)", head.columnLen[i]);
@@ -145,46 +441,176 @@ void Table::printSchema() {
             default:
                 assert(0);
         }
-        if (head.notNull & (1 << i)) printf(" NotNull");
-        if (head.hasIndex & (1 << i)) printf(" Indexed");
-        if (head.isPrimary & (1 << i)) printf(" Primary");
+        if (head.notNull.test(i)) printf(" NotNull");
+        if (head.hasIndex.test(i)) printf(" Indexed");
+        if (head.isPrimary.test(i)) printf(" Primary");
         printf("\n");
     }
+    if (isCompressed()) {
+        // the pages written back so far
+        long long stored, onDisk;
+        BufPageManager::getFileManager().getCompressedSize(fileID, stored, onDisk);
+        printf("Compressed: %d pages, %lld bytes compressed, %lld bytes on the disk\n",
+               head.pageTot, stored, onDisk);
+    }
 }
 
 bool Table::hasIndex(int col) {
-    return (head.hasIndex & (1 << col)) != 0;
+    return head.hasIndex.test(col);
 }
 
 bool Table::isPrimary(int col) {
-    return (head.isPrimary & (1 << col)) != 0;
+    return head.isPrimary.test(col);
 }
 
 RID_t Table::getNext(RID_t rid) {
-    int page_id, id, n;
-    n = (PAGE_SIZE - PAGE_FOOTER_SIZE) / head.recordByte;
-    n = (n < MAX_REC_PER_PAGE) ? n : MAX_REC_PER_PAGE;
-    if (rid == (RID_t) -1) {
-        page_id = 0;
-        id = n - 1;
-    } else {
-        page_id = rid / PAGE_SIZE;
-        id = (rid % PAGE_SIZE) / head.recordByte;
+    if (head.layout == TL_SLOTTED) return getNextSlotted(rid);
+    int pageID = firstDataPage(), idx = 0;
+    if (rid != (RID_t) -1) {
+        pageID = rid / PAGE_SIZE;
+        idx = (rid % PAGE_SIZE) / head.recordByte + 1;
+    }
+    for (; pageID < head.pageTot; pageID++, idx = 0) {
+        if (isMapPage(pageID)) continue;
+        idx = nextUsedRecord(readPage(pageID), idx);
+        if (idx != -1) return (RID_t) pageID * PAGE_SIZE + idx * head.recordByte;
+    }
+    return (RID_t) -1;
+}
+
+bool Table::scanPage(int &pageID, std::vector<RID_t> &rids) {
+    rids.clear();
+    for (pageID = std::max(pageID, firstDataPage()); pageID < head.pageTot; pageID++) {
+        if (isMapPage(pageID)) continue;
+        char *page = readPage(pageID);
+        RID_t first = (RID_t) pageID * PAGE_SIZE;
+        if (head.layout == TL_SLOTTED) {
+            int slotTot = slottedHead(page)->slotTot;
+            for (int slot = 0; slot < slotTot; slot++) {
+                Slot *s = slotAt(page, slot);
+                if (s->offset != 0 && !(s->len & SLOT_MOVED)) rids.push_back(first + slot);
+            }
+        } else {
+            auto footer = (const unsigned int *) (page + PAGE_SIZE - PAGE_CHECKSUM_SIZE - footerBytes());
+            int words = footerBytes() / 4, used = 0;
+            for (int i = 0; i < words; i++) used += __builtin_popcount(footer[i]);
+            rids.reserve((size_t) used);
+            for (int i = 0; i < words && (int) rids.size() < used; i++) {
+                // one RID for each bit set, lowest first
+                for (unsigned int w = footer[i]; w; w &= w - 1) {
+                    rids.push_back(first + (i * 32 + __builtin_ctz(w)) * head.recordByte);
+                }
+            }
+        }
+        if (!rids.empty()) {
+            pageID++;
+            return true;
+        }
     }
-    int index = BufPageManager::getInstance().getPage(fileID, page_id);
-    char *page = BufPageManager::getInstance().access(index);
+    return false;
+}
 
-    while (true) {
-        id++;
-        if (id == n) {
-            page_id++;
-            if (page_id >= head.pageTot) return (RID_t) -1;
-            index = BufPageManager::getInstance().getPage(fileID, page_id);
-            page = BufPageManager::getInstance().access(index);
-            id = 0;
+bool Table::scanColumn(int col, int &pageID, ColumnVector &vec) {
+    assert(0 <= col && col < head.columnTot);
+    vec.count = 0;
+    vec.width = head.columnType[col] == CT_VARCHAR ? head.columnLen[col] + 1 : 4;
+    bool slotted = head.layout == TL_SLOTTED;
+    int n = slotted ? 0 : recordsPerPage();
+    for (pageID = std::max(pageID, firstDataPage()); pageID < head.pageTot; pageID++) {
+        if (isMapPage(pageID)) continue;
+        char *page = readPage(pageID);
+        if (slotted) n = slottedHead(page)->slotTot;
+        vec.rids.resize((size_t) n);
+        vec.isNull.resize((size_t) n);
+        vec.values.resize((size_t) n * vec.width);
+        for (int idx = 0; idx < n; idx++) {
+            char *value = &vec.values[(size_t) vec.count * vec.width];
+            if (slotted) {
+                Slot *s = slotAt(page, idx);
+                if (s->offset == 0 || (s->len & SLOT_MOVED)) continue;
+                RID_t rid = (RID_t) pageID * PAGE_SIZE + idx;
+                // a forwarded record is read from another page
+                const char *record = (s->len & SLOT_FORWARD) ? readSlottedRecord(rid) : page + s->offset;
+                vec.isNull[vec.count] = !notNullBit(record, col);
+                copyPackedColumn(record, col, value);
+                if (record != page + s->offset) page = readPage(pageID);
+                vec.rids[vec.count] = rid;
+            } else {
+                idx = nextUsedRecord(page, idx);
+                if (idx == -1) break;
+                vec.isNull[vec.count] = !notNullBit(fieldPtr(page, idx, 0, head.columnOffset[0]), col);
+                memcpy(value, fieldPtr(page, idx, head.columnOffset[col], columnBytes(col)), vec.width);
+                vec.rids[vec.count] = (RID_t) pageID * PAGE_SIZE + idx * head.recordByte;
+            }
+            vec.count++;
+        }
+        if (vec.count > 0) {
+            pageID++;
+            return true;
         }
-        if (getFooter(page, id)) return (RID_t) page_id * PAGE_SIZE + id * head.recordByte;
     }
+    return false;
+}
+
+bool Table::scanBatch(const std::vector<int> &cols, RID_t &last, RecordBatch &batch) {
+    bool slotted = head.layout == TL_SLOTTED;
+    int pageID = firstDataPage(), idx = 0;
+    if (last != (RID_t) -1) {
+        pageID = last / PAGE_SIZE;
+        idx = (slotted ? last % PAGE_SIZE : last % PAGE_SIZE / head.recordByte) + 1;
+    }
+    batch.count = 0;
+    batch.rids.resize(BATCH_ROWS);
+    batch.columns.resize(cols.size());
+    for (size_t k = 0; k < cols.size(); k++) {
+        ColumnBatch &c = batch.columns[k];
+        assert(0 <= cols[k] && cols[k] < head.columnTot);
+        c.col = cols[k];
+        c.width = head.columnType[c.col] == CT_VARCHAR ? head.columnLen[c.col] + 1 : 4;
+        c.values.resize((size_t) BATCH_ROWS * c.width);
+        c.notNull.assign(BATCH_ROWS / 32, 0);
+    }
+    std::vector<int> rows;
+    for (; pageID < head.pageTot && batch.count < BATCH_ROWS; pageID++, idx = 0) {
+        if (isMapPage(pageID)) continue;
+        char *page = readPage(pageID);
+        if (slotted) {
+            int slotTot = slottedHead(page)->slotTot;
+            for (; idx < slotTot && batch.count < BATCH_ROWS; idx++) {
+                Slot *s = slotAt(page, idx);
+                if (s->offset == 0 || (s->len & SLOT_MOVED)) continue;
+                RID_t rid = (RID_t) pageID * PAGE_SIZE + idx;
+                // a forwarded record is read from another page
+                const char *record = (s->len & SLOT_FORWARD) ? readSlottedRecord(rid) : page + s->offset;
+                int i = batch.count++;
+                for (auto &c : batch.columns) {
+                    if (notNullBit(record, c.col)) c.notNull[i / 32] |= 1u << (i % 32);
+                    copyPackedColumn(record, c.col, c.value(i));
+                }
+                if (record != page + s->offset) page = readPage(pageID);
+                batch.rids[i] = rid;
+            }
+            continue;
+        }
+        rows.clear();
+        for (idx = nextUsedRecord(page, idx); idx != -1 && batch.count + (int) rows.size() < BATCH_ROWS;
+             idx = nextUsedRecord(page, idx + 1)) {
+            rows.push_back(idx);
+        }
+        int nullBytes = head.columnOffset[0];
+        for (auto &c : batch.columns) {
+            int offset = head.columnOffset[c.col], bytes = columnBytes(c.col);
+            for (size_t r = 0; r < rows.size(); r++) {
+                int i = batch.count + (int) r;
+                if (notNullBit(fieldPtr(page, rows[r], 0, nullBytes), c.col)) c.notNull[i / 32] |= 1u << (i % 32);
+                memcpy(c.value(i), fieldPtr(page, rows[r], offset, bytes), (size_t) c.width);
+            }
+        }
+        for (int r : rows) batch.rids[batch.count++] = (RID_t) pageID * PAGE_SIZE + r * head.recordByte;
+    }
+    if (batch.count == 0) return false;
+    last = batch.rids[batch.count - 1];
+    return true;
 }
 
 // return -1 if name exist, columnId otherwise
@@ -192,19 +618,24 @@ RID_t Table::getNext(RID_t rid) {
 int Table::addColumn(const char *name, ColumnType type, int size,
                      bool notNull, bool hasDefault, const char *data) {
     printf("adding %s %d %d\n", name, type, size);
-    assert(head.pageTot == 1);
+    assert(head.pageTot == head.catalogPages);
     assert(strlen(name) < MAX_NAME_LEN);
     for (int i = 0; i < head.columnTot; i++)
-        if (strcmp(head.columnName[i], name) == 0)
+        if (head.columnName[i] == name)
             return -1;
-    assert(head.columnTot < MAX_COLUMN_SIZE);
     int id = head.columnTot++;
-    strcpy(head.columnName[id], name);
-    head.columnType[id] = type;
-    head.columnOffset[id] = head.recordByte;
-    head.columnLen[id] = size;
-    if (notNull) head.notNull |= (1 << id);
-    head.defaultOffset[id] = -1;
+    if (id > 0 && id % 32 == 0) {
+        // another word of null bitmap before the columns
+        for (int i = 0; i < id; i++) head.columnOffset[i] += 4;
+        head.recordByte += 4;
+    }
+    head.columnName.push_back(name);
+    head.columnType.push_back(type);
+    head.columnOffset.push_back(head.recordByte);
+    head.columnLen.push_back(size);
+    head.defaultOffset.push_back(-1);
+    resizeColumns();
+    if (notNull) head.notNull.set(id);
     switch (type) {
         case CT_INT:
         case CT_FLOAT:
@@ -230,60 +661,66 @@ int Table::addColumn(const char *name, ColumnType type, int size,
     }
     assert(head.dataArrUsed <= MAX_DATA_SIZE);
     assert(head.recordByte <= PAGE_SIZE);
+    perPage = fitRecords(head.recordByte);
+    assert(head.layout != TL_SLOTTED ||
+           maxPackedBytes() <= SLOTTED_PAGE_END - (int) (sizeof(SlottedPageHead) + sizeof(Slot)));
+    growCatalog();
     return id;
 }
 
 void Table::createIndex(int col) {
+    assert(!readOnly);
     //assert(head.pageTot == 1);
-    assert((head.hasIndex & (1 << col)) == 0);
-    head.hasIndex |= 1 << col;
+    assert(!head.hasIndex.test(col));
+    head.hasIndex.set(col);
 }
 
 void Table::dropIndex(int col) {
-    assert((head.hasIndex & (1 << col)));
-    head.hasIndex &= ~(1 << col);
+    assert(!readOnly);
+    assert(head.hasIndex.test(col));
+    head.hasIndex.reset(col);
     colIndex[col].drop(permID, col);
 }
 
 void Table::setPrimary(int columnID) {
-    assert((head.notNull >> columnID) & 1);
-    head.isPrimary |= (1 << columnID);
+    assert(head.notNull.test(columnID));
+    head.isPrimary.set(columnID);
     ++head.primaryCount;
 }
 
 void Table::loadIndex() {
     for (int i = 0; i < head.columnTot; i++)
-        if (head.hasIndex & (1 << i)) {
+        if (head.hasIndex.test(i)) {
             colIndex[i].load(permID, i);
         }
 }
 
 void Table::storeIndex() {
     for (int i = 0; i < head.columnTot; i++)
-        if (head.hasIndex & (1 << i)) {
+        if (head.hasIndex.test(i)) {
             colIndex[i].store(permID, i);
         }
 }
 
 void Table::dropIndex() {
     for (int i = 0; i < head.columnTot; i++)
-        if (head.hasIndex & (1 << i)) {
+        if (head.hasIndex.test(i)) {
             colIndex[i].drop(permID, i);
         }
 }
 
 int Table::getFastCmp(RID_t rid, int col) {
-    char *p = select(rid, col);
-    if (p == nullptr) return 0;
+    ColumnView v = view(rid, col);
+    if (v.isNull) return 0;
     int res = 0;
     float tmp;
     switch (head.columnType[col]) {
         case CT_INT:
         case CT_DATE:
-            res = *(int *) p;
+            memcpy(&res, v.data, 4);
             break;
         case CT_FLOAT:
-            tmp = *(float *) p;
+            memcpy(&tmp, v.data, 4);
             if (tmp > 2e9)
                 res = (int) 2e9;
             else if (tmp < -2e9)
@@ -293,72 +730,251 @@ int Table::getFastCmp(RID_t rid, int col) {
             break;
         case CT_VARCHAR:
             res = 0;
-            for (size_t i = 0; i < 4; i++) {
+            for (int i = 0; i < 4; i++) {
                 res = res * 256;
-                if (i < strlen(p)) res += i;
+                if (i < v.len) res += i;
             }
             break;
         default:
             assert(false);
     }
-    delete[] p;
     return res;
 }
 
 bool Table::getIsNull(RID_t rid, int col) {
-    char *p = select(rid, col);
-    delete[] p;
-    return p == nullptr;
+    return view(rid, col).isNull;
 }
 
 void Table::eraseColIndex(RID_t rid, int col) {
+    assert(!batching);
     if (hasIndex(col)) {
         colIndex[col].erase(IndexKey(permID, rid, col, getFastCmp(rid, col), getIsNull(rid, col)));
     }
 }
 
 void Table::insertColIndex(RID_t rid, int col) {
-    if (hasIndex(col)) {
-        colIndex[col].insert(IndexKey(permID, rid, col, getFastCmp(rid, col), getIsNull(rid, col)));
+    if (!hasIndex(col)) return;
+    if (batching && col != checkedIndex) {
+        // the record was just inserted from the temp record
+        batchKeys[col].push_back(IndexKey(permID, rid, col, getFastCmp(-1, col), getIsNull(-1, col)));
+        return;
     }
+    colIndex[col].insert(IndexKey(permID, rid, col, getFastCmp(rid, col), getIsNull(rid, col)));
 }
 
-void Table::create(const char *tableName) {
+void Table::beginBatch() {
+    assert(!readOnly && !batching);
+    batching = true;
+    batchFirstPage = std::max(head.pageTot - 1, firstDataPage());
+    // checkPrimary finds the duplicates through the first primary column
+    checkedIndex = -1;
+    if (head.primaryCount > 1 && !initMode) {
+        checkedIndex = 1;
+        while (!isPrimary(checkedIndex)) checkedIndex++;
+    }
+}
+
+void Table::endBatch() {
+    assert(batching);
+    batching = false;
+    for (int pageID = batchFirstPage; pageID < head.pageTot; pageID++) {
+        if (isMapPage(pageID)) continue;
+        PageGuard page(fileID, pageID);
+        updateFreeSpace(pageID, page.data());
+    }
+    for (int i = 0; i < head.columnTot; i++) {
+        if (batchKeys[i].empty()) continue;
+        colIndex[i].insertBatch(batchKeys[i]);
+        std::vector<IndexKey>().swap(batchKeys[i]);
+    }
+}
+
+// the checks, foreign keys and defaults of the columns may come later
+int Table::catalogBytes() {
+    int bytes = (int) (sizeof(TableHeadFixed) + 3 * head.notNull.words.size() * sizeof(uint32_t));
+    for (int i = 0; i < head.columnTot; i++) {
+        bytes += (int) (head.columnName[i].size() + 1 + 3 * sizeof(int) + sizeof(ColumnType));
+    }
+    return bytes + (int) (sizeof(head.checkList) + sizeof(head.foreignKeyList) + sizeof(head.dataArr));
+}
+
+void Table::growCatalog() {
+    // the table has no data pages yet, the catalog grows into the next one
+    assert(head.pageTot == head.catalogPages);
+    while (head.catalogPages * CATALOG_PAGE_BYTES < catalogBytes()) {
+        PageGuard page = PageGuard::alloc(fileID, head.catalogPages);
+        page.markDirty();
+        head.pageTot = ++head.catalogPages;
+    }
+}
+
+// the column vectors, sets and indexes have an entry for each column
+void Table::resizeColumns() {
+    head.columnName.resize((size_t) head.columnTot);
+    head.columnOffset.resize((size_t) head.columnTot);
+    head.columnType.resize((size_t) head.columnTot);
+    head.columnLen.resize((size_t) head.columnTot);
+    head.defaultOffset.resize((size_t) head.columnTot);
+    head.notNull.resize(head.columnTot);
+    head.hasIndex.resize(head.columnTot);
+    head.isPrimary.resize(head.columnTot);
+    colIndex.resize((size_t) head.columnTot);
+    batchKeys.resize((size_t) head.columnTot);
+}
+
+bool Table::hasFormat() {
+    std::vector<char> page(PAGE_SIZE);
+    if (BufPageManager::getFileManager().readPage(fileID, 0, page.data()) != 0) return false;
+    uint32_t format;
+    memcpy(&format, page.data() + offsetof(TableHeadFixed, format), sizeof(format));
+    return format == TABLE_FORMAT;
+}
+
+void Table::loadHead() {
+    memcpy((TableHeadFixed *) &head, readPage(0), sizeof(TableHeadFixed));
+    std::vector<char> bytes((size_t) head.catalogPages * CATALOG_PAGE_BYTES);
+    for (int pageID = 0; pageID < head.catalogPages; pageID++) {
+        memcpy(&bytes[(size_t) pageID * CATALOG_PAGE_BYTES], readPage(pageID), CATALOG_PAGE_BYTES);
+    }
+    const char *p = bytes.data() + sizeof(TableHeadFixed);
+    auto get = [&p](void *data, size_t len) {
+        memcpy(data, p, len);
+        p += len;
+    };
+    head.notNull.clear();
+    head.hasIndex.clear();
+    head.isPrimary.clear();
+    resizeColumns();
+    for (ColumnSet *set: {&head.notNull, &head.hasIndex, &head.isPrimary}) {
+        get(set->words.data(), set->words.size() * sizeof(uint32_t));
+    }
+    for (int i = 0; i < head.columnTot; i++) {
+        head.columnName[i] = p;
+        p += head.columnName[i].size() + 1;
+        get(&head.columnOffset[i], sizeof(int));
+        get(&head.columnType[i], sizeof(ColumnType));
+        get(&head.columnLen[i], sizeof(int));
+        get(&head.defaultOffset[i], sizeof(int));
+    }
+    get(head.checkList, head.checkTot * sizeof(Check));
+    get(head.foreignKeyList, head.foreignKeyTot * sizeof(ForeignKey));
+    get(head.dataArr, (size_t) head.dataArrUsed);
+    perPage = fitRecords(head.recordByte);
+}
+
+void Table::storeHead() {
+    std::vector<char> bytes;
+    auto put = [&bytes](const void *data, size_t len) {
+        bytes.insert(bytes.end(), (const char *) data, (const char *) data + len);
+    };
+    put((const TableHeadFixed *) &head, sizeof(TableHeadFixed));
+    for (const ColumnSet *set: {&head.notNull, &head.hasIndex, &head.isPrimary}) {
+        put(set->words.data(), set->words.size() * sizeof(uint32_t));
+    }
+    for (int i = 0; i < head.columnTot; i++) {
+        put(head.columnName[i].c_str(), head.columnName[i].size() + 1);
+        put(&head.columnOffset[i], sizeof(int));
+        put(&head.columnType[i], sizeof(ColumnType));
+        put(&head.columnLen[i], sizeof(int));
+        put(&head.defaultOffset[i], sizeof(int));
+    }
+    put(head.checkList, head.checkTot * sizeof(Check));
+    put(head.foreignKeyList, head.foreignKeyTot * sizeof(ForeignKey));
+    put(head.dataArr, (size_t) head.dataArrUsed);
+    assert((int) bytes.size() <= head.catalogPages * CATALOG_PAGE_BYTES);
+    bytes.resize((size_t) head.catalogPages * CATALOG_PAGE_BYTES);
+    for (int pageID = 0; pageID < head.catalogPages; pageID++) {
+        PageGuard page(fileID, pageID);
+        memcpy(page.data(), &bytes[(size_t) pageID * CATALOG_PAGE_BYTES], CATALOG_PAGE_BYTES);
+        page.markDirty();
+    }
+}
+
+void Table::create(const char *tableName, TableLayout layout, bool compressed) {
     assert(!ready);
     this->tableName = std::string(tableName);
-    BufPageManager::getFileManager().createFile(tableName);
+    BufPageManager::getFileManager().createFile(tableName, compressed);
     fileID = BufPageManager::getFileManager().openFile(tableName);
     permID = BufPageManager::getFileManager().getFilePermID(fileID);
     BufPageManager::getInstance().allocPage(fileID, 0);
     RegisterManager::getInstance().checkIn(permID, this);
     ready = true;
-    head.pageTot = 1;
+    head.format = TABLE_FORMAT;
+    head.pageTot = head.catalogPages = 1;
+    head.layout = (int8_t) layout;
     head.recordByte = 4; // reserve first 4 bytes for notnull info
     //head.rowTot = 0;
     head.columnTot = 0;
     head.dataArrUsed = 0;
-    head.nextAvail = (unsigned int) -1;
-    head.notNull = 0;
+    head.columnName.clear();
+    head.columnOffset.clear();
+    head.columnType.clear();
+    head.columnLen.clear();
+    head.defaultOffset.clear();
+    head.notNull.clear();
+    head.hasIndex.clear();
+    head.isPrimary.clear();
+    colIndex.clear();
+    batchKeys.clear();
     head.checkTot = 0;
     head.foreignKeyTot = 0;
     head.primaryCount = 0;
     addColumn("RID", CT_INT, 10, true, false, nullptr);
     setPrimary(0);
+    fsmHint = head.pageTot;
+    lastPage = -1;
     buf = nullptr;
     for (auto &col: colIndex) {
         col.clear();
     }
 }
 
-void Table::open(const char *tableName) {
+void Table::open(const char *tableName, bool readOnly) {
     assert(ready == 0);
     this->tableName = std::string(tableName);
+    this->readOnly = readOnly;
     fileID = BufPageManager::getFileManager().openFile(tableName);
     permID = BufPageManager::getFileManager().getFilePermID(fileID);
+    // before any checksum, which an older file would only fail
+    if (!hasFormat()) {
+        BufPageManager::getFileManager().closeFile(fileID);
+        throw TableFormatError(this->tableName);
+    }
     RegisterManager::getInstance().checkIn(permID, this);
-    int index = BufPageManager::getInstance().getPage(fileID, 0);
-    memcpy(&head, BufPageManager::getInstance().access(index), sizeof(TableHead));
+    map = nullptr;
+    if (readOnly) {
+        map = BufPageManager::getFileManager().mapFile(fileID, mapSize);
+    }
+    if (map) {
+        int pageTot;
+        memcpy(&pageTot, map + offsetof(TableHeadFixed, pageTot), sizeof(int));
+        if (mapSize < (size_t) pageTot * PAGE_SIZE) {
+            // pages never written back, read them through the buffer
+            FileManager::unmapFile(map, mapSize);
+            map = nullptr;
+        } else {
+            mapVerified.assign(mapSize / PAGE_SIZE, false);
+        }
+    }
+    try {
+        loadHead();
+    } catch (const ChecksumError &) {
+        // a bad catalog page, the table is not opened
+        if (map) {
+            FileManager::unmapFile(map, mapSize);
+            map = nullptr;
+        }
+        RegisterManager::getInstance().checkOut(permID);
+        BufPageManager::getInstance().closeFile(fileID, false);
+        BufPageManager::getFileManager().closeFile(fileID);
+        throw;
+    }
+    if (!map) {
+        BufPageManager::getInstance().warmUp(fileID);
+    }
     ready = true;
+    fsmHint = firstDataPage();
+    lastPage = -1;
     buf = nullptr;
     for (auto &col: colIndex) {
         col.clear();
@@ -368,23 +984,40 @@ void Table::open(const char *tableName) {
 
 void Table::close() {
     assert(ready);
-    storeIndex();
-    int index = BufPageManager::getInstance().getPage(fileID, 0);
-    memcpy(BufPageManager::getInstance().access(index), &head, sizeof(TableHead));
-    BufPageManager::getInstance().markDirty(index);
+    if (batching) endBatch();
+    if (!readOnly) {
+        storeIndex();
+        storeHead();
+    }
+    if (map) {
+        FileManager::unmapFile(map, mapSize);
+        map = nullptr;
+    }
     RegisterManager::getInstance().checkOut(permID);
-    BufPageManager::getInstance().closeFile(fileID);
+    BufPageManager::getInstance().closeFile(fileID, !readOnly);
     BufPageManager::getFileManager().closeFile(fileID);
     ready = false;
     if (buf) {
         delete[] buf;
         buf = 0;
     }
+    delete[] rowBuf;
+    rowBuf = nullptr;
 }
 
 void Table::drop() {
     assert(ready == 1);
+    batching = false;
+    for (auto &keys : batchKeys) keys.clear();
     dropIndex();
+    if (map) {
+        FileManager::unmapFile(map, mapSize);
+        map = nullptr;
+    }
+    delete[] buf;
+    buf = nullptr;
+    delete[] rowBuf;
+    rowBuf = nullptr;
     RegisterManager::getInstance().checkOut(permID);
     BufPageManager::getInstance().closeFile(fileID, false);
     BufPageManager::getFileManager().closeFile(fileID);
@@ -392,11 +1025,11 @@ void Table::drop() {
 }
 
 std::string Table::genCheckError(int checkId) {
-    unsigned int &notNull = *(unsigned int *) buf;
+    // the failed check ends a group of ORed checks on the same column
     int ed = checkId + 1, st = checkId;
-    while (head.checkList[st - 1].col == head.checkList[checkId].col &&
-           head.checkList[st - 1].rel == RE_OR && head.checkList[checkId].rel == RE_OR) {
-        checkId++;
+    while (st > 0 && head.checkList[st - 1].col == head.checkList[checkId].col &&
+           head.checkList[st - 1].rel == RE_OR && head.checkList[st].rel == RE_OR) {
+        st--;
     }
     std::ostringstream stm;
     stm << "Insert Error: Col " << head.columnName[head.checkList[checkId].col];
@@ -408,7 +1041,7 @@ std::string Table::genCheckError(int checkId) {
         switch (head.columnType[chk.col]) {
             case CT_INT:
             case CT_DATE:
-                if (notNull & (1 << chk.col)) {
+                if (notNullBit(buf, chk.col)) {
                     stm << *(int *) (buf + head.columnOffset[chk.col]);
                 } else {
                     stm << "null";
@@ -416,7 +1049,7 @@ std::string Table::genCheckError(int checkId) {
                 stm << opTypeToString(chk.op) << *(int *) (head.dataArr + chk.offset);
                 break;
             case CT_FLOAT:
-                if (notNull & (1 << chk.col)) {
+                if (notNullBit(buf, chk.col)) {
                     stm << *(float *) (buf + head.columnOffset[chk.col]);
                 } else {
                     stm << "null";
@@ -424,7 +1057,7 @@ std::string Table::genCheckError(int checkId) {
                 stm << opTypeToString(chk.op) << *(float *) (head.dataArr + chk.offset);
                 break;
             case CT_VARCHAR:
-                if (notNull & (1 << chk.col)) {
+                if (notNullBit(buf, chk.col)) {
                     stm << *(int *) (buf + head.columnOffset[chk.col]);
                 } else {
                     stm << "null";
@@ -459,30 +1092,28 @@ bool Table::checkPrimary() {
             if (!isPrimary(col)) {
                 continue;
             }
-            char *tmp;
-            //char *new_record = getRecordTempPtr();
+            // the primary columns are never null
+            const char *tmp = view(rid, col).data;
             switch (head.columnType[col]) {
                 case CT_INT:
                 case CT_DATE:
-                    tmp = select(rid, col);
-                    if (*(int *) tmp == *(int *) (buf + head.columnOffset[col])) {
+                    if (memcmp(tmp, buf + head.columnOffset[col], 4) == 0) {
                         ++conflictCount;
                     }
-                    free(tmp);
                     break;
-                case CT_FLOAT:
-                    tmp = select(rid, col);
-                    if (*(float *) tmp == *(float *) (buf + head.columnOffset[col])) {
+                case CT_FLOAT: {
+                    float x, y;
+                    memcpy(&x, tmp, 4);
+                    memcpy(&y, buf + head.columnOffset[col], 4);
+                    if (x == y) {
                         ++conflictCount;
                     }
-                    free(tmp);
                     break;
+                }
                 case CT_VARCHAR:
-                    tmp = select(rid, col);
                     if (strcmp(tmp, buf + head.columnOffset[col]) == 0) {
                         ++conflictCount;
                     }
-                    free(tmp);
                     break;
                 default:
                     assert(false);
@@ -497,12 +1128,11 @@ bool Table::checkPrimary() {
 }
 
 std::string Table::checkValueConstraint() {
-    unsigned int &notNull = *(unsigned int *) buf;
     bool flag = true, checkResult = false;
     for (int i = 0; i < head.checkTot; i++) {
         auto chk = head.checkList[i];
         if (chk.offset == -1) {
-            checkResult |= (chk.op == OP_EQ) && (((~notNull) & (1 << chk.col)) == 0);
+            checkResult |= (chk.op == OP_EQ) && notNullBit(buf, chk.col);
         } else {
             switch (head.columnType[chk.col]) {
                 case CT_INT:
@@ -546,9 +1176,10 @@ std::string Table::checkForeignKeyConstraint() {
 }
 
 std::string Table::checkRecord() {
-    unsigned int &notNull = *(unsigned int *) buf;
-    if ((notNull & head.notNull) != head.notNull) {
-        return "Insert Error: not null column is null.";
+    for (int i = 0; i < head.columnTot; i++) {
+        if (head.notNull.test(i) && !notNullBit(buf, i)) {
+            return "Insert Error: not null column is null.";
+        }
     }
 
     if (!initMode) {
@@ -576,7 +1207,7 @@ int Table::getColumnCount() {
 // return -1 if not found
 int Table::getColumnID(const char *name) {
     for (int i = 1; i < head.columnTot; i++)
-        if (strcmp(head.columnName[i], name) == 0)
+        if (head.columnName[i] == name)
             return i;
     return -1;
 }
@@ -601,16 +1232,17 @@ void Table::clearTempRecord() {
 //   Result: col[1]>10 AND col[2]=='a' AND col[3]=='c' AND col[2]=='b'
 
 void Table::addCheck(int col, OpType op, char *data, RelType relation) {
-    UNUSED(op);
-    assert(head.pageTot == 1);
+    assert(head.pageTot == head.catalogPages);
     assert(head.checkTot < MAX_CHECK);
     int id = head.checkTot;
     head.checkList[id].col = col;
+    head.checkList[id].op = op;
     head.checkList[id].offset = head.dataArrUsed;
     head.checkList[id].rel = relation;
     if (data == nullptr) {
         head.checkList[id].offset = -1;
         head.checkTot++;
+        growCatalog();
         return;
     }
     switch (head.columnType[col]) {
@@ -630,6 +1262,7 @@ void Table::addCheck(int col, OpType op, char *data, RelType relation) {
     }
     assert(head.dataArrUsed <= MAX_DATA_SIZE);
     head.checkTot++;
+    growCatalog();
 }
 
 void Table::addForeignKeyConstraint(unsigned int col, unsigned int foreignTableId, unsigned int foreignColId) {
@@ -649,7 +1282,6 @@ std::string Table::setTempRecord(int col, const char *data) {
         buf = new char[head.recordByte];
         initTempRecord();
     }
-    unsigned int &notNull = *(unsigned int *) buf;
     switch (head.columnType[col]) {
         case CT_INT:
         case CT_DATE:
@@ -668,7 +1300,7 @@ std::string Table::setTempRecord(int col, const char *data) {
         default:
             assert(0);
     }
-    notNull |= (1u << col);
+    setNotNullBit(buf, col, true);
     return "";
 }
 
@@ -677,8 +1309,7 @@ void Table::setTempRecordNull(int col) {
         buf = new char[head.recordByte];
         initTempRecord();
     }
-    unsigned int &notNull = *(unsigned int *) buf;
-    if (notNull & (1u << col)) notNull ^= (1u << col);
+    setNotNullBit(buf, col, false);
 }
 
 // return value change. Urgly interface.
@@ -686,42 +1317,120 @@ void Table::setTempRecordNull(int col) {
 // return error description otherwise.
 std::string Table::insertTempRecord() {
     assert(buf != nullptr);
-    if (head.nextAvail == (RID_t) -1) {
+    if (readOnly) return "ERROR: table is read-only";
+    if (head.layout == TL_SLOTTED) return insertSlottedRecord();
+    int pageID = findFreePage(1);
+    if (pageID == -1) {
+        allocPage();
+        pageID = head.pageTot - 1;
+    }
+    // checkRecord fetches other pages
+    PageGuard page(fileID, pageID);
+    int idx = freeRecord(page.data());
+    if (idx == -1) {
+        assert(batching);
         allocPage();
+        pageID = head.pageTot - 1;
+        page = PageGuard(fileID, pageID);
+        idx = 0;
     }
-    int rid = head.nextAvail;
-    setTempRecord(0, (char *) &head.nextAvail);
+    RID_t rid = (RID_t) pageID * PAGE_SIZE + idx * head.recordByte;
+    setTempRecord(0, (char *) &rid);
     auto error = checkRecord();
     if (!error.empty()) {
         printf("Error occurred when inserting record, aborting...\n");
         return error;
     }
-    int pageID = head.nextAvail / PAGE_SIZE;
-    int offset = head.nextAvail % PAGE_SIZE;
-    int index = BufPageManager::getInstance().getPage(fileID, pageID);
-    char *page = BufPageManager::getInstance().access(index);
-    head.nextAvail = *(unsigned int *) (page + offset);
-    memcpy(page + offset, buf, head.recordByte);
-    BufPageManager::getInstance().markDirty(index);
-    inverseFooter(page, offset / head.recordByte);
+    storeRecord(page.data(), idx, buf);
+    page.markDirty();
+    inverseFooter(page.data(), idx);
+    if (!batching) updateFreeSpace(pageID, page.data());
+    lastPage = pageID;
     for (int i = 0; i < head.columnTot; i++) insertColIndex(rid, i);
     return "";
 }
 
 void Table::dropRecord(RID_t rid) {
+    assert(!readOnly);
+    if (head.layout == TL_SLOTTED) {
+        dropSlottedRecord(rid);
+        return;
+    }
     int pageID = rid / PAGE_SIZE;
     int offset = rid % PAGE_SIZE;
     for (int i = 0; i < head.columnTot; i++) {
-        if (head.hasIndex & (1 << i)) eraseColIndex(rid, i);
+        if (head.hasIndex.test(i)) eraseColIndex(rid, i);
     }
-    int index = BufPageManager::getInstance().getPage(fileID, pageID);
-    char *page = BufPageManager::getInstance().access(index);
-    char *record = page + offset;
-    unsigned int &next = *(unsigned int *) record;
-    next = head.nextAvail;
-    head.nextAvail = rid;
-    inverseFooter(page, offset / head.recordByte);
-    BufPageManager::getInstance().markDirty(index);
+    PageGuard page(fileID, pageID);
+    inverseFooter(page.data(), offset / head.recordByte);
+    page.markDirty();
+    updateFreeSpace(pageID, page.data());
+}
+
+// The records are moved from the last one on, each to the first page with
+// room for it, until the pages before it are full.
+int Table::vacuum() {
+    assert(!readOnly && !batching);
+    std::vector<RID_t> rids, page;
+    for (int pageID = 0; scanPage(pageID, page);) rids.insert(rids.end(), page.begin(), page.end());
+    std::vector<char> record((size_t) head.recordByte);
+    char packed[PAGE_SIZE];
+    lastPage = -1;
+    for (auto it = rids.rbegin(); it != rids.rend(); ++it) {
+        RID_t rid = *it;
+        int pageID = rid / PAGE_SIZE;
+        int dest, len = 0;
+        if (head.layout == TL_SLOTTED) {
+            // a record that has moved leaves its page and its slot
+            int last = pageID;
+            char *home = readPage(pageID);
+            Slot *s = slotAt(home, rid % PAGE_SIZE);
+            if (s->len & SLOT_FORWARD) {
+                RID_t to;
+                memcpy(&to, home + s->offset, 4);
+                last = std::max(last, (int) (to / PAGE_SIZE));
+            }
+            unpackRecord(readSlottedRecord(rid), record.data());
+            len = packRecord(record.data(), packed);
+            dest = findFreePage((len + FSM_UNIT - 1) / FSM_UNIT);
+            if (dest == -1 || dest >= last) continue;
+        } else {
+            dest = findFreePage(1);
+            // the pages before this record are full
+            if (dest == -1 || dest >= pageID) break;
+            getRecord(rid, record.data());
+        }
+        dropRecord(rid);
+        PageGuard page(fileID, dest);
+        RID_t to;
+        if (head.layout == TL_SLOTTED) {
+            int slot = emptySlot(page.data());
+            to = (RID_t) dest * PAGE_SIZE + slot;
+            memcpy(record.data() + head.columnOffset[0], &to, 4);
+            packRecord(record.data(), packed);
+            memcpy(placeSlotted(page.data(), slot, len, 0), packed, len);
+        } else {
+            int idx = freeRecord(page.data());
+            to = (RID_t) dest * PAGE_SIZE + idx * head.recordByte;
+            memcpy(record.data() + head.columnOffset[0], &to, 4);
+            storeRecord(page.data(), idx, record.data());
+            inverseFooter(page.data(), idx);
+        }
+        page.markDirty();
+        updateFreeSpace(dest, page.data());
+        for (int i = 0; i < head.columnTot; i++) insertColIndex(to, i);
+    }
+    int pageTot = head.pageTot;
+    while (pageTot > firstDataPage() && (isMapPage(pageTot - 1) || isEmptyPage(readPage(pageTot - 1)))) {
+        pageTot--;
+    }
+    int cut = head.pageTot - pageTot;
+    if (cut > 0) {
+        BufPageManager::getInstance().truncateFile(fileID, pageTot);
+        head.pageTot = pageTot;
+    }
+    fsmHint = firstDataPage();
+    return cut;
 }
 
 std::string Table::loadRecordToTemp(RID_t rid, char *page, int offset) {
@@ -729,11 +1438,10 @@ std::string Table::loadRecordToTemp(RID_t rid, char *page, int offset) {
     if (buf == nullptr) {
         buf = new char[head.recordByte];
     }
-    char *record = page + offset;
     if (!getFooter(page, offset / head.recordByte)) {
         return "ERROR: RID invalid";
     }
-    memcpy(buf, record, (size_t) head.recordByte);
+    loadRecord(page, offset / head.recordByte, buf);
     return "";
 }
 
@@ -741,12 +1449,13 @@ std::string Table::modifyRecord(RID_t rid, int col, char *data) {
     if (data == nullptr) {
         return modifyRecordNull(rid, col);
     }
+    if (readOnly) return "ERROR: table is read-only";
+    if (head.layout == TL_SLOTTED) return modifySlottedRecord(rid, col, data);
     int pageID = rid / PAGE_SIZE;
     int offset = rid % PAGE_SIZE;
-    int index = BufPageManager::getInstance().getPage(fileID, pageID);
-    char *page = BufPageManager::getInstance().access(index);
-    char *record = page + offset;
-    std::string err = loadRecordToTemp(rid, page, offset);
+    // checkRecord and the index maintenance fetch other pages
+    PageGuard page(fileID, pageID);
+    std::string err = loadRecordToTemp(rid, page.data(), offset);
     if (!err.empty()) {
         return err;
     }
@@ -760,19 +1469,20 @@ std::string Table::modifyRecord(RID_t rid, int col, char *data) {
         return err;
     }
     eraseColIndex(rid, col);
-    memcpy(record, buf, head.recordByte);
-    BufPageManager::getInstance().markDirty(index);
+    storeRecord(page.data(), offset / head.recordByte, buf);
+    page.markDirty();
     insertColIndex(rid, col);
     return "";
 }
 
 std::string Table::modifyRecordNull(RID_t rid, int col) {
+    if (readOnly) return "ERROR: table is read-only";
+    if (head.layout == TL_SLOTTED) return modifySlottedRecord(rid, col, nullptr);
     int pageID = rid / PAGE_SIZE;
     int offset = rid % PAGE_SIZE;
-    int index = BufPageManager::getInstance().getPage(fileID, pageID);
-    char *page = BufPageManager::getInstance().access(index);
-    char *record = page + offset;
-    std::string err = loadRecordToTemp(rid, page, offset);
+    // checkRecord and the index maintenance fetch other pages
+    PageGuard page(fileID, pageID);
+    std::string err = loadRecordToTemp(rid, page.data(), offset);
     if (!err.empty()) {
         return err;
     }
@@ -783,8 +1493,8 @@ std::string Table::modifyRecordNull(RID_t rid, int col) {
         return err;
     }
     eraseColIndex(rid, col);
-    memcpy(record, buf, head.recordByte);
-    BufPageManager::getInstance().markDirty(index);
+    storeRecord(page.data(), offset / head.recordByte, buf);
+    page.markDirty();
     insertColIndex(rid, col);
     return "";
 }
@@ -793,13 +1503,25 @@ int Table::getRecordBytes() {
     return head.recordByte;
 }
 
+// the pointer is only valid until the next page fetch,
+// use a PageGuard to keep the page in the buffer longer.
+// A TL_SLOTTED or TL_PAX record is copied to a buffer valid until the next call.
 char *Table::getRecordTempPtr(RID_t rid) {
+    if (head.layout == TL_SLOTTED) {
+        if (rowBuf == nullptr) rowBuf = new char[head.recordByte];
+        unpackRecord(readSlottedRecord(rid), rowBuf);
+        return rowBuf;
+    }
     int pageID = rid / PAGE_SIZE;
     int offset = rid % PAGE_SIZE;
-    assert(1 <= pageID && pageID < head.pageTot);
-    auto index = BufPageManager::getInstance().getPage(fileID, pageID);
-    auto page = BufPageManager::getInstance().access(index);
+    assert(firstDataPage() <= pageID && pageID < head.pageTot);
+    auto page = readPage(pageID);
     assert(getFooter(page, offset / head.recordByte));
+    if (head.layout == TL_PAX) {
+        if (rowBuf == nullptr) rowBuf = new char[head.recordByte];
+        loadRecord(page, offset / head.recordByte, rowBuf);
+        return rowBuf;
+    }
     return page + offset;
 }
 
@@ -808,6 +1530,241 @@ void Table::getRecord(RID_t rid, char *buf) {
     memcpy(buf, ptr, (size_t) head.recordByte);
 }
 
+int Table::packRecord(const char *record, char *packed) {
+    int nullBytes = head.columnOffset[0];
+    memcpy(packed, record, (size_t) nullBytes);
+    int pos = nullBytes + 4 * head.columnTot;
+    for (int i = 0; i < head.columnTot; i++) {
+        char *field = packed + nullBytes + 4 * i;
+        const char *value = record + head.columnOffset[i];
+        if (head.columnType[i] != CT_VARCHAR) {
+            memcpy(field, value, 4);
+            continue;
+        }
+        uint16_t ref[2] = {0, 0};
+        if (notNullBit(record, i)) {
+            size_t len = strlen(value);
+            ref[0] = (uint16_t) pos;
+            ref[1] = (uint16_t) len;
+            memcpy(packed + pos, value, len + 1);
+            pos += (int) len + 1;
+        }
+        memcpy(field, ref, 4);
+    }
+    // whole words, so that the fields of the records stay aligned
+    return (pos + 3) & ~3;
+}
+
+void Table::unpackRecord(const char *packed, char *record) {
+    int nullBytes = head.columnOffset[0];
+    memcpy(record, packed, (size_t) nullBytes);
+    for (int i = 0; i < head.columnTot; i++) {
+        const char *field = packed + nullBytes + 4 * i;
+        char *value = record + head.columnOffset[i];
+        if (head.columnType[i] != CT_VARCHAR) {
+            memcpy(value, field, 4);
+            continue;
+        }
+        uint16_t ref[2];
+        memcpy(ref, field, 4);
+        memcpy(value, packed + ref[0], ref[1]);
+        value[ref[1]] = '\0';
+    }
+}
+
+void Table::copyPackedColumn(const char *packed, int col, char *value) {
+    const char *field = packed + head.columnOffset[0] + 4 * col;
+    if (head.columnType[col] != CT_VARCHAR) {
+        memcpy(value, field, 4);
+        return;
+    }
+    uint16_t ref[2];
+    memcpy(ref, field, 4);
+    memcpy(value, packed + ref[0], ref[1]);
+    value[ref[1]] = '\0';
+}
+
+int Table::maxPackedBytes() {
+    int bytes = head.columnOffset[0] + 4 * head.columnTot;
+    for (int i = 0; i < head.columnTot; i++) {
+        if (head.columnType[i] == CT_VARCHAR) bytes += head.columnLen[i] + 1;
+    }
+    return bytes;
+}
+
+char *Table::readSlottedRecord(RID_t rid) {
+    int pageID = rid / PAGE_SIZE;
+    int slot = rid % PAGE_SIZE;
+    assert(firstDataPage() <= pageID && pageID < head.pageTot);
+    char *page = readPage(pageID);
+    assert(slot < slottedHead(page)->slotTot);
+    Slot *s = slotAt(page, slot);
+    assert(s->offset != 0);
+    if (s->len & SLOT_FORWARD) {
+        RID_t to;
+        memcpy(&to, page + s->offset, 4);
+        page = readPage(to / PAGE_SIZE);
+        s = slotAt(page, to % PAGE_SIZE);
+        assert(s->len & SLOT_MOVED);
+    }
+    return page + s->offset;
+}
+
+PageGuard Table::findSlottedPage(int len, int &pageID) {
+    pageID = findFreePage((len + FSM_UNIT - 1) / FSM_UNIT);
+    if (pageID == -1) {
+        allocPage();
+        pageID = head.pageTot - 1;
+    }
+    PageGuard page(fileID, pageID);
+    if (slottedRoom(page.data(), emptySlot(page.data())) < len) {
+        assert(batching);
+        allocPage();
+        pageID = head.pageTot - 1;
+        page = PageGuard(fileID, pageID);
+    }
+    return page;
+}
+
+RID_t Table::getNextSlotted(RID_t rid) {
+    int pageID = firstDataPage(), slot = -1;
+    if (rid != (RID_t) -1) {
+        pageID = rid / PAGE_SIZE;
+        slot = rid % PAGE_SIZE;
+    }
+    for (; pageID < head.pageTot; pageID++, slot = -1) {
+        if (isMapPage(pageID)) continue;
+        char *page = readPage(pageID);
+        int slotTot = slottedHead(page)->slotTot;
+        for (slot++; slot < slotTot; slot++) {
+            Slot *s = slotAt(page, slot);
+            if (s->offset != 0 && !(s->len & SLOT_MOVED)) {
+                return (RID_t) pageID * PAGE_SIZE + slot;
+            }
+        }
+    }
+    return (RID_t) -1;
+}
+
+std::string Table::insertSlottedRecord() {
+    char packed[PAGE_SIZE];
+    int len = packRecord(buf, packed);
+    int pageID;
+    PageGuard page = findSlottedPage(len, pageID);
+    int slot = emptySlot(page.data());
+    RID_t rid = (RID_t) pageID * PAGE_SIZE + slot;
+    setTempRecord(0, (char *) &rid);
+    auto error = checkRecord();
+    if (!error.empty()) {
+        printf("Error occurred when inserting record, aborting...\n");
+        return error;
+    }
+    packRecord(buf, packed);
+    memcpy(placeSlotted(page.data(), slot, len, 0), packed, len);
+    page.markDirty();
+    if (!batching) updateFreeSpace(pageID, page.data());
+    lastPage = pageID;
+    for (int i = 0; i < head.columnTot; i++) insertColIndex(rid, i);
+    return "";
+}
+
+void Table::dropSlottedRecord(RID_t rid) {
+    int pageID = rid / PAGE_SIZE;
+    int slot = rid % PAGE_SIZE;
+    for (int i = 0; i < head.columnTot; i++) {
+        if (head.hasIndex.test(i)) eraseColIndex(rid, i);
+    }
+    PageGuard page(fileID, pageID);
+    Slot *s = slotAt(page.data(), slot);
+    if (s->len & SLOT_FORWARD) {
+        RID_t to;
+        memcpy(&to, page.data() + s->offset, 4);
+        PageGuard moved(fileID, to / PAGE_SIZE);
+        freeSlot(moved.data(), to % PAGE_SIZE);
+        moved.markDirty();
+        updateFreeSpace(to / PAGE_SIZE, moved.data());
+    }
+    freeSlot(page.data(), slot);
+    page.markDirty();
+    updateFreeSpace(pageID, page.data());
+}
+
+// A record that does not fit in its page any more moves to another page,
+// and its slot keeps the new RID, so the RID and the indexes stay valid.
+void Table::storeSlottedRecord(RID_t rid) {
+    char packed[PAGE_SIZE];
+    int len = packRecord(buf, packed);
+    int homeID = rid / PAGE_SIZE;
+    int slot = rid % PAGE_SIZE;
+    PageGuard home(fileID, homeID);
+    Slot *s = slotAt(home.data(), slot);
+    if (s->len & SLOT_FORWARD) {
+        RID_t to;
+        memcpy(&to, home.data() + s->offset, 4);
+        PageGuard moved(fileID, to / PAGE_SIZE);
+        Slot *m = slotAt(moved.data(), to % PAGE_SIZE);
+        int old = m->len & SLOT_LEN_MASK;
+        moved.markDirty();
+        if (len <= old) {
+            memcpy(moved.data() + m->offset, packed, len);
+            slottedHead(moved.data())->usedBytes -= old - len;
+            m->len = (uint16_t) (len | SLOT_MOVED);
+            updateFreeSpace(to / PAGE_SIZE, moved.data());
+            return;
+        }
+        freeSlot(moved.data(), to % PAGE_SIZE);
+        updateFreeSpace(to / PAGE_SIZE, moved.data());
+    } else if (len <= (s->len & SLOT_LEN_MASK)) {
+        slottedHead(home.data())->usedBytes -= (s->len & SLOT_LEN_MASK) - len;
+        s->len = (uint16_t) len;
+        memcpy(home.data() + s->offset, packed, len);
+        home.markDirty();
+        updateFreeSpace(homeID, home.data());
+        return;
+    }
+    home.markDirty();
+    clearSlot(home.data(), slot);
+    if (slottedRoom(home.data(), slot) >= len) {
+        memcpy(placeSlotted(home.data(), slot, len, 0), packed, len);
+        updateFreeSpace(homeID, home.data());
+        return;
+    }
+    int pageID;
+    PageGuard other = findSlottedPage(len, pageID);
+    int otherSlot = emptySlot(other.data());
+    memcpy(placeSlotted(other.data(), otherSlot, len, SLOT_MOVED), packed, len);
+    other.markDirty();
+    updateFreeSpace(pageID, other.data());
+    RID_t to = (RID_t) pageID * PAGE_SIZE + otherSlot;
+    memcpy(placeSlotted(home.data(), slot, 4, SLOT_FORWARD), &to, 4);
+    updateFreeSpace(homeID, home.data());
+}
+
+std::string Table::modifySlottedRecord(RID_t rid, int col, const char *data) {
+    assert(col != 0);
+    if (buf == nullptr) {
+        buf = new char[head.recordByte];
+    }
+    unpackRecord(readSlottedRecord(rid), buf);
+    std::string err;
+    if (data == nullptr) {
+        setTempRecordNull(col);
+    } else {
+        err = setTempRecord(col, data);
+        if (!err.empty()) {
+            return err;
+        }
+    }
+    err = checkRecord();
+    if (!err.empty()) {
+        return err;
+    }
+    eraseColIndex(rid, col);
+    storeSlottedRecord(rid);
+    insertColIndex(rid, col);
+    return "";
+}
+
 int Table::getColumnOffset(int col) {
     return head.columnOffset[col];
 }
@@ -819,33 +1776,63 @@ ColumnType Table::getColumnType(int col) {
 //return 0 when null
 //return value in tempbuf when rid = -1
 char *Table::select(RID_t rid, int col) {
-    char *ptr;
-    if (rid != (RID_t) -1) {
-        ptr = getRecordTempPtr(rid);
-    } else {
-        ptr = buf;
-    }
-    unsigned int &notNull = *(unsigned int *) ptr;
-    char *buf;
-    if ((~notNull) & (1 << col)) {
+    ColumnView v = view(rid, col);
+    if (v.isNull) {
         return nullptr;
     }
+    char *buf;
     switch (head.columnType[col]) {
         case CT_INT:
         case CT_DATE:
         case CT_FLOAT:
             buf = new char[4];
-            memcpy(buf, ptr + getColumnOffset(col), 4);
+            memcpy(buf, v.data, 4);
             return buf;
         case CT_VARCHAR:
             buf = new char[head.columnLen[col] + 1];
-            strcpy(buf, ptr + getColumnOffset(col));
+            memcpy(buf, v.data, (size_t) v.len + 1);
             return buf;
         default:
             assert(0);
     }
 }
 
+// only the null bitmap and the field are read
+ColumnView Table::view(RID_t rid, int col) {
+    assert(0 <= col && col < head.columnTot);
+    ColumnView v;
+    const char *bits;
+    if (rid == (RID_t) -1) {
+        bits = buf;
+        v.data = buf + head.columnOffset[col];
+    } else if (head.layout == TL_SLOTTED) {
+        const char *record = readSlottedRecord(rid);
+        bits = record;
+        v.data = record + head.columnOffset[0] + 4 * col;
+        if (head.columnType[col] == CT_VARCHAR) {
+            uint16_t ref[2];
+            memcpy(ref, v.data, 4);
+            v.data = record + ref[0];
+        }
+    } else {
+        int pageID = rid / PAGE_SIZE;
+        int idx = rid % PAGE_SIZE / head.recordByte;
+        assert(firstDataPage() <= pageID && pageID < head.pageTot);
+        char *page = readPage(pageID);
+        assert(getFooter(page, idx));
+        bits = fieldPtr(page, idx, 0, head.columnOffset[0]);
+        v.data = fieldPtr(page, idx, head.columnOffset[col], columnBytes(col));
+    }
+    v.isNull = !notNullBit(bits, col);
+    if (v.isNull) {
+        v.data = nullptr;
+        v.len = 0;
+    } else {
+        v.len = head.columnType[col] == CT_VARCHAR ? (int) strlen(v.data) : 4;
+    }
+    return v;
+}
+
 RID_t Table::selectIndexLowerBound(int col, const char *data) {
     if (data == nullptr) {
         return selectIndexLowerBoundNull(col);
@@ -898,7 +1885,7 @@ RID_t Table::selectReveredIndexNext(int col) {
     return colIndex[col].reversedNext();
 }
 
-char *Table::getColumnName(int col) {
+const char *Table::getColumnName(int col) {
     assert(0 <= col && col < head.columnTot);
-    return head.columnName[col];
+    return head.columnName[col].c_str();
 }
\ No newline at end of file
@@ -4,9 +4,24 @@
 #include "../constants.h"
 #include "Compare.h"
 #include "Index.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// the first bytes of a table file, changed with the format of its pages
+#define TABLE_FORMAT 0x31424453u // "SDB1", pages with checksums
 
 extern bool initMode;
 
+// thrown by Table::open for a file not starting with TABLE_FORMAT, e.g.
+// written before the pages had checksums
+struct TableFormatError : std::runtime_error {
+    explicit TableFormatError(const std::string &file)
+            : std::runtime_error("Table file " + file + " is of an older format, load it again") {}
+};
+
 struct Check {
     int col;
     int offset;
@@ -20,30 +35,174 @@ struct ForeignKey {
     unsigned int foreign_col;
 };
 
-struct TableHead {
-    int8_t columnTot, primaryCount, checkTot, foreignKeyTot;
-    int pageTot, recordByte, dataArrUsed;
-    unsigned int nextAvail, notNull, hasIndex, isPrimary;
+enum TableLayout {
+    TL_ROW,    // fixed-size records, the bitmap of the used ones in the page footer
+    TL_SLOTTED, // variable-size records found through a slot directory
+    TL_PAX      // fixed-size records, each column of a page kept together
+};
+
+// a bit for each column, in as many words as the columns need
+struct ColumnSet {
+    std::vector<uint32_t> words;
 
-    char columnName[MAX_COLUMN_SIZE][MAX_NAME_LEN];
-    int columnOffset[MAX_COLUMN_SIZE];
-    ColumnType columnType[MAX_COLUMN_SIZE];
-    int columnLen[MAX_COLUMN_SIZE];
-    int defaultOffset[MAX_COLUMN_SIZE];
+    void clear() { words.clear(); }
+
+    // words for `columns` columns, the new bits are not set
+    void resize(int columns) { words.resize((size_t) (columns + 31) / 32, 0); }
+
+    bool test(int col) const { return col / 32 < (int) words.size() && ((words[col / 32] >> (col % 32)) & 1); }
+
+    void set(int col) {
+        if (col / 32 >= (int) words.size()) resize(col + 1);
+        words[col / 32] |= 1u << (col % 32);
+    }
+
+    void reset(int col) {
+        if (col / 32 < (int) words.size()) words[col / 32] &= ~(1u << (col % 32));
+    }
+};
+
+// the part of the head stored as it is at the start of the catalog
+struct TableHeadFixed {
+    uint32_t format; // TABLE_FORMAT
+    int16_t columnTot, primaryCount;
+    int8_t checkTot, foreignKeyTot, layout;
+    int pageTot, recordByte, dataArrUsed, catalogPages;
+};
+
+// The head is kept in the catalog pages at the start of the file: the fixed
+// part, the column sets and the columnTot entries of the columns, then the
+// used part of the other arrays, see Table::storeHead. The catalog has room
+// for all the checks, foreign keys and defaults of the columns, so it only
+// grows while the columns are added and the table has no data pages yet.
+struct TableHead : TableHeadFixed {
+    ColumnSet notNull, hasIndex, isPrimary;
+
+    std::vector<std::string> columnName;
+    std::vector<int> columnOffset;
+    std::vector<ColumnType> columnType;
+    std::vector<int> columnLen;
+    std::vector<int> defaultOffset;
     Check checkList[MAX_CHECK];
     ForeignKey foreignKeyList[MAX_FOREIGN_KEY];
     char dataArr[MAX_DATA_SIZE];
 };
 
+// A TL_SLOTTED page starts with this head and the slot directory, and the
+// records are packed from the end of the page towards the directory. A RID
+// is pageID * PAGE_SIZE + slot, so it does not change when the page is
+// compacted. A record is the null bitmap and 4 bytes for each column, then
+// the VARCHAR values. A VARCHAR column keeps the offset of its value in the
+// record and its length, 2 bytes each. The records take whole words.
+struct SlottedPageHead {
+    uint16_t slotTot;   // entries in the directory
+    uint16_t freeEnd;   // the records are in [freeEnd, SLOTTED_PAGE_END)
+    uint16_t usedBytes; // the rest of the page is free after compaction
+    uint16_t reserved;
+};
+
+struct Slot {
+    uint16_t offset; // 0 if the slot is empty
+    uint16_t len;    // with the SLOT_ flags
+};
+
+#define SLOTTED_PAGE_END (PAGE_SIZE - PAGE_CHECKSUM_SIZE)
+// the record grew out of its page, the slot holds the RID it moved to
+#define SLOT_FORWARD 0x8000
+// a record moved here from the slot forwarding to it, skipped by scans
+#define SLOT_MOVED 0x4000
+#define SLOT_LEN_MASK 0x3FFF
+
+// A record starts with its null bitmap, a bit for each column set if it is
+// not null, in whole words: columnOffset[0] bytes.
+
+// A TL_ROW page holds as many records as fit with a bit for each in the
+// footer, the bitmap of the used ones just before the checksum.
+// A TL_PAX page holds as many records as a TL_ROW page and the same footer,
+// but the bytes [offset, offset + width) of all its records are stored
+// together, in the minipage starting at recordsPerPage * offset. The first
+// minipage is the null bitmaps. A RID is the same as for TL_ROW.
+
+// The page after the catalog and every FSM_SPAN + 1 pages after it are
+// free-space map pages, with a byte for each of the FSM_SPAN data pages
+// following them: the free records of a TL_ROW or TL_PAX page, or the free
+// bytes of a TL_SLOTTED page in units of FSM_UNIT, at most 255. 0 means the
+// page is full.
+#define FSM_SPAN (PAGE_SIZE - PAGE_CHECKSUM_SIZE)
+#define FSM_UNIT 32
+
+// a column of a record in its page, or in the temp record, returned by
+// Table::view. It is valid until the next page fetch.
+struct ColumnView {
+    const char *data; // nullptr if null, a VARCHAR ends with '\0'
+    int len;          // 4, or the length of the VARCHAR
+    bool isNull;
+};
+
+// one column of the records of a page, filled by Table::scanColumn
+struct ColumnVector {
+    int count;
+    int width;                // bytes of each value, a VARCHAR ends with '\0'
+    std::vector<RID_t> rids;
+    std::vector<char> isNull;
+    std::vector<char> values; // count * width bytes
+};
+
+// records in a RecordBatch at most, a multiple of 32
+#define BATCH_ROWS 1024
+
+// A column of the records of a RecordBatch. The values are an array of int
+// for a CT_INT or CT_DATE column, of float for a CT_FLOAT column, and of
+// strings of `width` bytes ending with '\0' for a CT_VARCHAR column.
+struct ColumnBatch {
+    int col;
+    int width;                     // bytes of each value
+    std::vector<char> values;      // BATCH_ROWS * width bytes
+    std::vector<uint32_t> notNull; // a bit for each record, set if it is not null
+
+    bool isNull(int i) const { return !((notNull[i / 32] >> (i % 32)) & 1); }
+
+    char *value(int i) { return &values[(size_t) i * width]; }
+
+    const int *ints() const { return (const int *) values.data(); }
+
+    const float *floats() const { return (const float *) values.data(); }
+};
+
+// some columns of up to BATCH_ROWS records, filled by Table::scanBatch
+struct RecordBatch {
+    int count;
+    std::vector<RID_t> rids;
+    std::vector<ColumnBatch> columns; // in the order they were asked for
+};
+
+class PageGuard;
+
 class Table {
     friend class Database;
 
     TableHead head;
-    bool ready;
+    bool ready, readOnly;
     int fileID, permID;
     char *buf;
-    Index colIndex[MAX_COLUMN_SIZE];
+    // a record of a TL_SLOTTED table unpacked by getRecordTempPtr
+    char *rowBuf;
+    // the whole file in read-only mode, nullptr when reading through the buffer
+    char *map;
+    size_t mapSize;
+    std::vector<bool> mapVerified; // the mapped pages whose checksum was verified
+    std::vector<Index> colIndex; // an entry for each column
     std::string tableName;
+    // the data pages before it are full, where the search for room starts
+    int fsmHint;
+    // the page of the last insert, tried first
+    int lastPage;
+    // records in a TL_ROW or TL_PAX page, set when recordByte changes
+    int perPage;
+    // the index entries of a batch of inserts, bulk-loaded at its end
+    bool batching;
+    int checkedIndex, batchFirstPage;
+    std::vector<std::vector<IndexKey>> batchKeys; // an entry for each column
 
     Table();
 
@@ -53,10 +212,96 @@ class Table {
 
     void allocPage();
 
+    bool isMapPage(int pageID);
+
+    // the free-space map page with the entry of the data page
+    int mapPageOf(int pageID);
+
+    int firstDataPage();
+
+    // the head in the catalog pages, at least head.catalogPages of them
+    int catalogBytes();
+
+    // add catalog pages until the head fits, before the first data page
+    void growCatalog();
+
+    // size the per-column state by head.columnTot
+    void resizeColumns();
+
+    // whether the file starts with TABLE_FORMAT, read around the buffer
+    bool hasFormat();
+
+    void loadHead();
+
+    void storeHead();
+
+    // the free-space map entry of the data page
+    int freeSpace(char *page);
+
+    void updateFreeSpace(int pageID, char *page);
+
+    // no record is in the data page
+    bool isEmptyPage(char *page);
+
+    // a data page with an entry of at least `need`, -1 if there is none
+    int findFreePage(int need);
+
+    // the first free record of a TL_ROW or TL_PAX page
+    int freeRecord(const char *page);
+
+    // the first used record of a TL_ROW or TL_PAX page from `idx` on, -1
+    // if there is none
+    int nextUsedRecord(const char *page, int idx);
+
+    // column `col` of a packed record in the format of ColumnVector::values
+    void copyPackedColumn(const char *packed, int col, char *value);
+
+    // size of the records of a TL_SLOTTED table, from the temp record format
+    int packRecord(const char *record, char *packed);
+
+    void unpackRecord(const char *packed, char *record);
+
+    int maxPackedBytes();
+
+    // the packed record, after the forwarding if it has moved
+    char *readSlottedRecord(RID_t rid);
+
+    // a page with room for a record of `len` bytes, a new one if needed
+    PageGuard findSlottedPage(int len, int &pageID);
+
+    RID_t getNextSlotted(RID_t rid);
+
+    std::string insertSlottedRecord();
+
+    void dropSlottedRecord(RID_t rid);
+
+    // write the temp record back to the place of `rid`
+    void storeSlottedRecord(RID_t rid);
+
+    // data == nullptr sets the column to null
+    std::string modifySlottedRecord(RID_t rid, int col, const char *data);
+
+    // bytes of the bitmap ending a TL_ROW or TL_PAX page
+    int footerBytes();
+
+    // bytes taken by the column in the temp record format
+    int columnBytes(int col);
+
+    // where the bytes [offset, offset + width) of record `idx` are in a
+    // TL_ROW or TL_PAX page
+    char *fieldPtr(char *page, int idx, int offset, int width);
+
+    void loadRecord(char *page, int idx, char *record);
+
+    void storeRecord(char *page, int idx, const char *record);
+
     void inverseFooter(const char *page, int idx);
 
     int getFooter(const char *page, int idx);
 
+    // a page to read from, valid until the next page fetch
+    char *readPage(int pageID);
+
     void loadIndex();
 
     void storeIndex();
@@ -71,9 +316,11 @@ class Table {
 
     void insertColIndex(RID_t rid, int col);
 
-    void create(const char *tableName);
+    // the pages of a compressed table are compressed on the disk
+    void create(const char *tableName, TableLayout layout = TL_ROW, bool compressed = false);
 
-    void open(const char *tableName);
+    // a read-only table is read from an mmap of its file when possible
+    void open(const char *tableName, bool readOnly = false);
 
     void close();
 
@@ -92,6 +339,15 @@ class Table {
 public:
     std::string getTableName();
 
+    // ID of the table file in BufPageManager and FileManager
+    int getFileID();
+
+    bool isReadOnly();
+
+    TableLayout getLayout();
+
+    bool isCompressed();
+
     void printSchema();
 
     bool hasIndex(int col);
@@ -100,6 +356,25 @@ public:
 
     RID_t getNext(RID_t rid);
 
+    // Fill `rids` with the RIDs of the next page holding records, from
+    // `pageID` on, in the order of getNext, and move `pageID` past it. Start
+    // with pageID = 0, return false at the end. The footer of a TL_ROW or
+    // TL_PAX page is read a word at a time.
+    bool scanPage(int &pageID, std::vector<RID_t> &rids);
+
+    // Fill `vec` with column `col` of the next page holding records, from
+    // `pageID` on, and move `pageID` past it. Start with pageID = 0, return
+    // false at the end. Only the minipages of the column and of the null
+    // bitmaps are read in a TL_PAX table.
+    bool scanColumn(int col, int &pageID, ColumnVector &vec);
+
+    // Fill `batch` with columns `cols` of the next BATCH_ROWS records after
+    // `last`, or of all the rest, in the order of getNext, and move `last`
+    // to the last of them. Start with last = -1, return false at the end.
+    // The columns are copied column by column from each page, so only their
+    // minipages and the null bitmaps are read in a TL_PAX table.
+    bool scanBatch(const std::vector<int> &cols, RID_t &last, RecordBatch &batch);
+
     // return -1 if name exist, columnId otherwise
     // size: maxlen for varchar, outputwidth for int
     int addColumn(const char *name, ColumnType type, int size,
@@ -143,8 +418,22 @@ public:
     // return error description otherwise.
     std::string insertTempRecord();
 
+    // The records inserted until endBatch fill the pages one after another,
+    // and their index entries and free-space map entries are written at
+    // endBatch, the index entries sorted and bulk-loaded. Only the index
+    // checkRecord looks up is kept up to date in the meantime. Records may
+    // not be dropped or modified during a batch.
+    void beginBatch();
+
+    void endBatch();
+
     void dropRecord(RID_t rid);
 
+    // Move the records of the last pages to the room in the first ones,
+    // with new RIDs and index entries, and cut the data pages left empty
+    // off the end of the file. Return the pages cut off.
+    int vacuum();
+
     std::string loadRecordToTemp(RID_t rid, char *page, int offset);
 
     std::string modifyRecord(RID_t rid, int col, char *data);
@@ -153,6 +442,9 @@ public:
 
     int getRecordBytes();
 
+    // records in a TL_ROW or TL_PAX page
+    int recordsPerPage();
+
     char *getRecordTempPtr(RID_t rid);
 
     void getRecord(RID_t rid, char *buf);
@@ -165,6 +457,9 @@ public:
     //return value in tempbuf when rid = -1
     char *select(RID_t rid, int col);
 
+    // the same without a copy
+    ColumnView view(RID_t rid, int col);
+
     RID_t selectIndexLowerBound(int col, const char *data);
 
     RID_t selectIndexLowerBoundEqual(int col, const char *data);
@@ -181,7 +476,7 @@ public:
 
     RID_t selectReveredIndexNext(int col);
 
-    char *getColumnName(int col);
+    const char *getColumnName(int col);
 
 };
 
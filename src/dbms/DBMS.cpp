@@ -13,6 +13,7 @@
 #include <sql_parser/Expression.h>
 
 #include "DBMS.h"
+#include "io/BufPageManager.h"
 
 DBMS::DBMS() {
     current = new Database();
@@ -26,6 +27,16 @@ bool DBMS::requireDbOpen() {
     return true;
 }
 
+bool DBMS::requireWritable() {
+    if (!requireDbOpen())
+        return false;
+    if (current->isReadOnly()) {
+        printf("Database %s is read-only!\n", current->getDBName().c_str());
+        return false;
+    }
+    return true;
+}
+
 void DBMS::printReadableException(int err) {
     printf("Exception: ");
     printf("%s\n", Exception2String[err]);
@@ -113,6 +124,10 @@ Expression DBMS::dbTypeToExprType(char *data, ColumnType type) {
     return v;
 }
 
+Expression DBMS::viewToExprType(const ColumnView &view, ColumnType type) {
+    return dbTypeToExprType((char *) view.data, type);
+}
+
 term_type DBMS::ColumnTypeToExprType(const ColumnType &type) {
     switch (type) {
         case CT_INT:
@@ -184,27 +199,34 @@ char *DBMS::ExprTypeToDbType(Expression &val, term_type desiredType) {
     return ret;
 }
 
-void DBMS::cacheColumns(Table *tb, int rid) {
+static std::string shortTableName(Table *tb) {
     auto tb_name = tb->getTableName();
     tb_name = tb_name.substr(tb_name.find('.') + 1); //strip database name
-    tb_name = tb_name.substr(0, tb_name.find('.'));
+    return tb_name.substr(0, tb_name.find('.'));
+}
+
+void DBMS::cacheColumns(Table *tb, int rid) {
+    auto tb_name = shortTableName(tb);
     cleanColumnCacheByTable(tb_name.c_str());
+    // copy the strings, the page may be gone before they are used
+    auto &strings = cachedStrings[tb];
+    strings.resize((size_t) tb->getRecordBytes());
+    size_t used = 0;
     for (int i = 1; i <= tb->getColumnCount() - 1; ++i)//exclude RID
     {
-        auto *tmp = tb->select(rid, i);
-        updateColumnCache(tb->getColumnName(i),
-                          tb_name.c_str(),
-                          dbTypeToExprType(tmp, tb->getColumnType(i))
-        );
-        pendingFree.push_back(tmp);
+        auto view = tb->view(rid, i);
+        auto val = viewToExprType(view, tb->getColumnType(i));
+        if (val.type == TERM_STRING) {
+            val.value.value_s = &strings[used];
+            memcpy(val.value.value_s, view.data, (size_t) view.len + 1);
+            used += view.len + 1;
+        }
+        updateColumnCache(tb->getColumnName(i), tb_name.c_str(), val);
     }
 }
 
 void DBMS::freeCachedColumns() {
-    for (const auto &ptr : pendingFree) {
-        delete (ptr);
-    }
-    pendingFree.clear();
+    cachedStrings.clear();
 }
 
 DBMS::IDX_TYPE DBMS::checkIndexAvailability(Table *tb, RID_t *rid_l, RID_t *rid_u, int *col, expr_node *condition) {
@@ -266,7 +288,6 @@ RID_t DBMS::nextWithIndex(Table *tb, IDX_TYPE type, int col, RID_t rid, RID_t ri
 }
 
 void DBMS::iterateRecords(linked_list *tables, expr_node *condition, CallbackFunc callback) {
-    auto rid = (unsigned int) -1;
     auto tb = (Table *) tables->data;
     if (!tables->next) { // fallback to one table
         return iterateRecords(tb, condition, callback);
@@ -278,9 +299,12 @@ void DBMS::iterateRecords(linked_list *tables, expr_node *condition, CallbackFun
         }
         printf("Iterating two tables with index failed, falling back to enumeration.\n");
     }
-    while ((rid = tb->getNext(rid)) != (RID_t) -1) {
-        cacheColumns(tb, rid);
-        iterateRecords(tables->next, condition, callback);
+    std::vector<RID_t> rids;
+    for (int pageID = 0; tb->scanPage(pageID, rids);) {
+        for (RID_t rid : rids) {
+            cacheColumns(tb, rid);
+            iterateRecords(tables->next, condition, callback);
+        }
     }
 }
 
@@ -403,9 +427,8 @@ void DBMS::iterateRecords(Table *tb, expr_node *condition, CallbackFunc callback
     RID_t rid = (RID_t) -1, rid_u;
     int col;
     IDX_TYPE idx = checkIndexAvailability(tb, &rid, &rid_u, &col, condition);
-    if (idx == IDX_NONE)
-        rid = tb->getNext((unsigned int) -1);
-    for (; rid != (RID_t) -1; rid = nextWithIndex(tb, idx, col, rid, rid_u)) {
+    // return false if the condition fails to evaluate
+    auto visit = [&](RID_t rid) {
         cacheColumns(tb, rid);
         if (condition) {
             Expression val_cond;
@@ -415,17 +438,32 @@ void DBMS::iterateRecords(Table *tb, expr_node *condition, CallbackFunc callback
                 cond = convertToBool(val_cond);
             } catch (int err) {
                 printReadableException(err);
-                return;
+                return false;
             } catch (...) {
                 printf("Exception occur %d\n", __LINE__);
-                return;
+                return false;
             }
             if (!cond)
-                continue;
+                return true;
         }
         callback(tb, rid);
+        return true;
+    };
+    if (idx == IDX_NONE) {
+        // the records of a page at a time
+        std::vector<RID_t> rids;
+        for (int pageID = 0; tb->scanPage(pageID, rids);) {
+            for (RID_t r : rids) {
+                if (!visit(r))
+                    return;
+            }
+        }
+        return;
+    }
+    for (; rid != (RID_t) -1; rid = nextWithIndex(tb, idx, col, rid, rid_u)) {
+        if (!visit(rid))
+            return;
     }
-
 }
 
 int DBMS::isAggregate(const linked_list *column_expr) {
@@ -446,6 +484,40 @@ int DBMS::isAggregate(const linked_list *column_expr) {
     return flags;
 }
 
+bool DBMS::aggregateByColumns(Table *tb, const linked_list *column_expr, AggregateFunc accumulate) {
+    std::vector<int> cols;
+    for (const linked_list *j = column_expr; j; j = j->next) {
+        auto node = (expr_node *) j->data;
+        int c = 0; // COUNT(*) counts the RIDs
+        if (node->left) {
+            if (node->left->node_type != TERM_COLUMN)
+                return false;
+            auto column = node->left->column;
+            if (column->table && shortTableName(tb) != column->table)
+                return false;
+            c = tb->getColumnID(column->column);
+            // the strings would be gone with the page in MIN and MAX
+            if (c == -1 || (tb->getColumnType(c) == CT_VARCHAR && node->op != OPER_COUNT))
+                return false;
+        }
+        cols.push_back(c);
+    }
+    RecordBatch batch;
+    for (RID_t last = (RID_t) -1; tb->scanBatch(cols, last, batch);) {
+        int col = 0;
+        for (const linked_list *j = column_expr; j; j = j->next, col++) {
+            auto node = (expr_node *) j->data;
+            auto type = tb->getColumnType(cols[col]);
+            ColumnBatch &values = batch.columns[col];
+            for (int i = 0; i < batch.count; i++) {
+                accumulate(col, node, values.isNull(i) ? Expression(TERM_NULL)
+                                                       : dbTypeToExprType(values.value(i), type));
+            }
+        }
+    }
+    return true;
+}
+
 void DBMS::freeLinkedList(linked_list *t) {
     linked_list *next;
     for (; t; t = next) {
@@ -466,22 +538,31 @@ void DBMS::exit() {
         current->close();
 }
 
-void DBMS::switchToDB(const char *name) {
+void DBMS::switchToDB(const char *name, bool readOnly) {
     if (current->isOpen())
         current->close();
 
-    current->open(name);
+    try {
+        current->open(name, readOnly);
+    } catch (const std::runtime_error &e) {
+        printf("%s\n", e.what());
+    }
 }
 
 void DBMS::createTable(const table_def *table) {
-    if (!requireDbOpen())
+    if (!requireWritable())
         return;
     assert(table->name != NULL);
     if (current->getTableByName(table->name)) {
         printf("Table `%s` already exists\n", table->name);
         return;
     }
-    Table *tab = current->createTable(table->name);
+    TableLayout layout = TL_ROW;
+    if (table->layout == TABLE_LAYOUT_SLOTTED)
+        layout = TL_SLOTTED;
+    else if (table->layout == TABLE_LAYOUT_PAX)
+        layout = TL_PAX;
+    Table *tab = current->createTable(table->name, layout, table->compressed != 0);
     std::vector<column_defs *> column_rev;
     column_defs *column = table->columns;
     bool succeed = true;
@@ -637,7 +718,7 @@ void DBMS::dropDB(const char *db_name) {
 }
 
 void DBMS::dropTable(const char *table) {
-    if (!requireDbOpen())
+    if (!requireWritable())
         return;
     current->dropTableByName(table);
     printf("Table %s dropped!\n", table);
@@ -655,6 +736,33 @@ void DBMS::listTables() {
     printf("==========\n");
 }
 
+void DBMS::showBufferStatus() {
+    BufferStats stats;
+    BufPageManager::getInstance().getStats(stats);
+    long long requests = stats.hits + stats.misses;
+    printf("Buffer status:\n");
+    printf("Frames: %d in %d shards, %d used, %d dirty, %d pinned\n",
+           stats.capacity, stats.shards, stats.used, stats.dirty, stats.pinned);
+    printf("Requests: %lld, hits: %lld, misses: %lld, hit ratio: %.2f%%\n",
+           requests, stats.hits, stats.misses, requests ? 100.0 * stats.hits / requests : 0.0);
+    printf("Pages read: %lld, read ahead: %lld, of which used: %lld\n",
+           stats.reads, stats.readAheadPages, stats.readAheadHits);
+    printf("Pages written: %lld by queries, %lld by the flusher\n",
+           stats.foregroundWrites, stats.backgroundWrites);
+    printf("Evictions: %lld clean, %lld dirty\n", stats.cleanEvictions, stats.dirtyEvictions);
+    printf("Pages warmed up: %lld\n", stats.warmedPages);
+    printf("Checksums: %lld pages in %.3f ms (%s), %lld mismatches\n", stats.checksumPages,
+           stats.checksumNanos / 1e6, Crc32c::isHardware() ? "SSE4.2" : "software", stats.checksumFailures);
+    if (current->isOpen()) {
+        printf("Pages of each table (resident, dirty):\n");
+        for (const auto &name : current->getTableNames()) {
+            int fileID = current->getTableByName(name)->getFileID();
+            printf("%s %d %d\n", name.c_str(), stats.residentPages[fileID], stats.dirtyPages[fileID]);
+        }
+    }
+    printf("==========\n");
+}
+
 void DBMS::selectRow(const linked_list *tables, const linked_list *column_expr, expr_node *condition) {
     int flags;
     if (!requireDbOpen())
@@ -686,44 +794,58 @@ void DBMS::selectRow(const linked_list *tables, const linked_list *column_expr,
     if (flags == 2) { //aggregate functions only
         std::map<int, Expression> aggregate_buf;
         std::map<int, int> rowCount;
+        // a string kept is copied, the cached columns are overwritten by the next row
+        std::map<int, std::string> aggregate_str;
+        auto keep = [&aggregate_buf, &aggregate_str](int col, const Expression &val) -> void {
+            aggregate_buf[col] = val;
+            if (val.type == TERM_STRING) {
+                aggregate_str[col] = val.value.value_s;
+                aggregate_buf[col].value.value_s = &aggregate_str[col][0];
+            }
+        };
+        auto accumulate = [&rowCount, &aggregate_buf, &keep](int col, expr_node *node, const Expression &val) -> void {
+            if (node->left == nullptr || val.type != TERM_NULL) {
+                rowCount[col]++;
+                if (node->op != OPER_COUNT && !aggregate_buf.count(col)) {
+                    keep(col, val);
+                } else {
+                    switch (node->op) {
+                        case OPER_MIN:
+                            if (val < aggregate_buf[col])
+                                keep(col, val);
+                            break;
+                        case OPER_MAX:
+                            if (aggregate_buf[col] < val)
+                                keep(col, val);
+                            break;
+                        case OPER_SUM:
+                        case OPER_AVG:
+                            aggregate_buf[col] += val;
+                            break;
+                        default:
+                            break;
+                    }
+                }
+            }
+        };
         try {
-            iterateRecords(openedTables, condition,
-                           [&rowCount, &aggregate_buf, &column_expr, this](Table *tb, int rid) -> void {
-                               UNUSED(tb);
-                               UNUSED(rid);
-                               int col = 0;
-                               for (const linked_list *j = column_expr; j; j = j->next, col++) {
-                                   auto node = (expr_node *) j->data;
-                                   Expression val;
-                                   if (node->op != OPER_COUNT) {
-                                       val = calcExpression(node->left);
-                                   }
-                                   if (node->left == nullptr || val.type != TERM_NULL) {
-                                       rowCount[col]++;
-                                       if (node->op != OPER_COUNT && !aggregate_buf.count(col)) {
-                                           aggregate_buf[col] = (val);
-                                       } else {
-                                           switch (node->op) {
-                                               case OPER_MIN:
-                                                   if (val < aggregate_buf[col])
-                                                       aggregate_buf[col] = val;
-                                                   break;
-                                               case OPER_MAX:
-                                                   if (aggregate_buf[col] < val)
-                                                       aggregate_buf[col] = val;
-                                                   break;
-                                               case OPER_SUM:
-                                               case OPER_AVG:
-                                                   aggregate_buf[col] += val;
-                                                   break;
-                                               default:
-                                                   break;
-                                           }
+            // only the columns aggregated are read when there is no condition
+            if (condition || openedTables->next ||
+                !aggregateByColumns((Table *) openedTables->data, column_expr, accumulate))
+                iterateRecords(openedTables, condition,
+                               [&accumulate, &column_expr, this](Table *tb, int rid) -> void {
+                                   UNUSED(tb);
+                                   UNUSED(rid);
+                                   int col = 0;
+                                   for (const linked_list *j = column_expr; j; j = j->next, col++) {
+                                       auto node = (expr_node *) j->data;
+                                       Expression val;
+                                       if (node->op != OPER_COUNT) {
+                                           val = calcExpression(node->left);
                                        }
+                                       accumulate(col, node, val);
                                    }
-
-                               }
-                           });
+                               });
         } catch (int err) {
             printReadableException(err);
             return;
@@ -760,28 +882,28 @@ void DBMS::selectRow(const linked_list *tables, const linked_list *column_expr,
     iterateRecords(openedTables, condition, [&column_expr, &count, this](Table *tb, int rid) -> void {
         std::vector<Expression> output_buf;
         if (!column_expr) { // FIXME: will only select from one table when using *
-            for (int i = tb->getColumnCount() - 1; i > 0; --i) {
-                output_buf.push_back(
-                        dbTypeToExprType(
-                                tb->select(rid, i),
-                                tb->getColumnType(i)
-                        )
-                );
+            // print each column before the page is fetched for the next one
+            printf("| ");
+            for (int i = 1; i < tb->getColumnCount(); ++i) {
+                printExprVal(viewToExprType(tb->view(rid, i), tb->getColumnType(i)));
+                printf(" | ");
             }
-        } else {
-            for (const linked_list *j = column_expr; j; j = j->next) {
-                auto *node = (expr_node *) j->data;
-                Expression val;
-                try {
-                    val = calcExpression(node);
-                    output_buf.push_back(val);
-                } catch (int err) {
-                    printReadableException(err);
-                    return;
-                } catch (...) {
-                    printf("Exception occur %d\n", __LINE__);
-                    return;
-                }
+            printf("\n");
+            count++;
+            return;
+        }
+        for (const linked_list *j = column_expr; j; j = j->next) {
+            auto *node = (expr_node *) j->data;
+            Expression val;
+            try {
+                val = calcExpression(node);
+                output_buf.push_back(val);
+            } catch (int err) {
+                printReadableException(err);
+                return;
+            } catch (...) {
+                printf("Exception occur %d\n", __LINE__);
+                return;
             }
         }
         printf("| ");
@@ -800,7 +922,7 @@ void DBMS::selectRow(const linked_list *tables, const linked_list *column_expr,
 
 void DBMS::updateRow(const char *table, expr_node *condition, column_ref *column, expr_node *eval) {
     Table *tb;
-    if (!requireDbOpen())
+    if (!requireWritable())
         return;
     if (!(tb = current->getTableByName(table))) {
         printf("Table %s not found\n", table);
@@ -844,7 +966,7 @@ void DBMS::updateRow(const char *table, expr_node *condition, column_ref *column
 void DBMS::deleteRow(const char *table, expr_node *condition) {
     std::vector<RID_t> toBeDeleted;
     Table *tb;
-    if (!requireDbOpen())
+    if (!requireWritable())
         return;
     if (!(tb = current->getTableByName(table))) {
         printf("Table %s not found\n", table);
@@ -863,7 +985,7 @@ void DBMS::deleteRow(const char *table, expr_node *condition) {
 
 void DBMS::insertRow(const char *table, const linked_list *columns, const linked_list *values) {
     Table *tb;
-    if (!requireDbOpen())
+    if (!requireWritable())
         return;
     if (!(tb = current->getTableByName(table))) {
         printf("Table %s not found\n", table);
@@ -893,6 +1015,8 @@ void DBMS::insertRow(const char *table, const linked_list *columns, const linked
     printf("Inserting into %lu columns\n", colId.size());
     tb->clearTempRecord();
     int count = 0;
+    // the index entries of all the rows are loaded at once
+    tb->beginBatch();
     for (const linked_list *i = values; i; i = i->next) {
         const linked_list *expr_list = (linked_list *) i->data;
         unsigned int cnt = 0;
@@ -913,10 +1037,10 @@ void DBMS::insertRow(const char *table, const linked_list *columns, const linked
                 val = calcExpression(node);
             } catch (int err) {
                 printReadableException(err);
-                return;
+                goto done;
             } catch (...) {
                 printf("Exception occur %d\n", __LINE__);
-                return;
+                goto done;
             }
             //printf("Column [%d] value ", *it);
             //printExprVal(val);
@@ -924,7 +1048,7 @@ void DBMS::insertRow(const char *table, const linked_list *columns, const linked
             auto colType = tb->getColumnType(*it);
             if (!checkColumnType(colType, val)) {
                 printf("Wrong data type\n");
-                return;
+                goto done;
             }
             auto exprType = ColumnTypeToExprType(colType);
             result = tb->setTempRecord(*it, ExprTypeToDbType(val, exprType));
@@ -943,11 +1067,13 @@ void DBMS::insertRow(const char *table, const linked_list *columns, const linked
         next_rec:;
     }
     printf("%d rows inserted.\n", count);
+    done:
+    tb->endBatch();
 }
 
 void DBMS::createIndex(column_ref *tb_col) {
     Table *tb;
-    if (!requireDbOpen())
+    if (!requireWritable())
         return;
     if (!(tb = current->getTableByName(tb_col->table))) {
         printf("Table %s not found\n", tb_col->table);
@@ -962,7 +1088,7 @@ void DBMS::createIndex(column_ref *tb_col) {
 
 void DBMS::dropIndex(column_ref *tb_col) {
     Table *tb;
-    if (!requireDbOpen())
+    if (!requireWritable())
         return;
     if (!(tb = current->getTableByName(tb_col->table))) {
         printf("Table %s not found\n", tb_col->table);
@@ -989,6 +1115,17 @@ void DBMS::descTable(const char *name) {
     tb->printSchema();
 }
 
+void DBMS::vacuumTable(const char *name) {
+    Table *tb;
+    if (!requireWritable())
+        return;
+    if (!(tb = current->getTableByName(name))) {
+        printf("Table %s not found\n", name);
+        return;
+    }
+    printf("%d pages freed\n", tb->vacuum());
+}
+
 bool DBMS::valueExistInTable(const char *value, const ForeignKey &key) {
     auto table = current->getTableById(key.foreign_table_id);
     auto result = table->selectIndexLowerBoundEqual(key.foreign_col, value);
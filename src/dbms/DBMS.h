@@ -1,6 +1,7 @@
 #ifndef __DBMS_H__
 #define __DBMS_H__
 
+#include <map>
 #include "backend/Database.h"
 #include "sql_parser/type_def.h"
 #include "sql_parser/Expression.h"
@@ -10,12 +11,16 @@ class DBMS {
         IDX_NONE, IDX_LOWWER, IDX_UPPER, IDX_EQUAL
     };
     Database *current;
-    std::vector<char *> pendingFree;
+    // the strings of the columns cached for each table
+    std::map<Table *, std::vector<char>> cachedStrings;
 
     DBMS();
 
     bool requireDbOpen();
 
+    // also refuse the statements changing a read-only database
+    bool requireWritable();
+
     void printReadableException(int err);
 
     void printExprVal(const Expression &val);
@@ -24,6 +29,9 @@ class DBMS {
 
     Expression dbTypeToExprType(char *data, ColumnType type);
 
+    // a VARCHAR still points into the page
+    Expression viewToExprType(const ColumnView &view, ColumnType type);
+
     char *ExprTypeToDbType(Expression &val, term_type desiredType);
 
     term_type ColumnTypeToExprType(const ColumnType& type);
@@ -50,6 +58,13 @@ class DBMS {
 
     int isAggregate(const linked_list *column_expr);
 
+    using AggregateFunc = std::function<void(int, expr_node *, const Expression &)>;
+
+    // Aggregate the plain columns of a table with no condition a batch of
+    // records at a time, through Table::scanBatch. Return false if some
+    // argument is not a column of the table, or a VARCHAR that is not counted.
+    bool aggregateByColumns(Table *tb, const linked_list *column_expr, AggregateFunc accumulate);
+
     void freeLinkedList(linked_list *t);
 
 public:
@@ -57,7 +72,7 @@ public:
 
     void exit();
 
-    void switchToDB(const char *name);
+    void switchToDB(const char *name, bool readOnly = false);
 
     void createTable(const table_def *table);
 
@@ -67,6 +82,8 @@ public:
 
     void listTables();
 
+    void showBufferStatus();
+
     void selectRow(const linked_list *tables, const linked_list *column_expr, expr_node *condition);
 
     void updateRow(const char *table, expr_node *condition, column_ref *column, expr_node *eval);
@@ -81,6 +98,8 @@ public:
 
     void descTable(const char *name);
 
+    void vacuumTable(const char *name);
+
     bool valueExistInTable(const char* value, const ForeignKey& key);
 };
 
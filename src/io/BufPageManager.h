@@ -3,44 +3,812 @@
 
 #include "FileManager.h"
 #include "FindReplace.h"
+#include "TwoQReplace.h"
+#include "ClockProReplace.h"
 #include "../util/HashMap.h"
+#include "../util/Crc32c.h"
+#include <sys/mman.h>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
+#define HUGE_PAGE_SIZE (2 << 20)
+// at most this many pages are written by the flusher in one batch
+#define FLUSH_BATCH 256
+// the first read-ahead window of a sequential scan, doubled on each read-ahead
+#define READ_AHEAD_MIN 4
+// a shard has at least this many frames
+#define SHARD_MIN_FRAMES 64
+// the pages in the buffer when the program exits, loaded again when their
+// files are opened next time
+#define WARM_UP_FILE "buffer.warm"
+
+// a snapshot of the buffer counters, see BufPageManager::getStats
+struct BufferStats {
+    int capacity, shards;
+    int used, dirty, pinned;
+    long long hits, misses;
+    long long reads;                // pages read, including read-ahead
+    long long foregroundWrites, backgroundWrites;
+    long long cleanEvictions, dirtyEvictions;
+    long long readAheadPages, readAheadHits;
+    long long warmedPages;          // loaded by the warm-up thread
+    long long checksumPages;        // pages checksummed on write or verified on read
+    long long checksumFailures;     // pages read with a wrong checksum
+    long long checksumNanos;        // time spent on the checksums
+    int residentPages[MAX_FILE_NUM]; // frames of each fileID
+    int dirtyPages[MAX_FILE_NUM];
+};
+
+// thrown when a page has to be loaded and all the frames of its shard are
+// pinned
+struct BufferFullError : std::runtime_error {
+    BufferFullError() : std::runtime_error("all the buffer frames are pinned") {}
+};
+
+// thrown when a page asked for is read with a wrong checksum, unless the
+// reads are best-effort, see BufPageManager::setBestEffortReads
+struct ChecksumError : std::runtime_error {
+    ChecksumError(int fileID, int pageID)
+            : std::runtime_error("checksum mismatch: page " + std::to_string(pageID) +
+                                 " of file " + std::to_string(fileID)) {}
+};
+
+// Frames are identified by their index in [0, cap). The frames are split into
+// shards of `shardCap` consecutive frames, and a page always goes to the same
+// shard, chosen by a hash of (fileID, pageID). Each shard has its own lookup
+// table, lists, replacement policy and latch, so that pages of different
+// shards are fetched in parallel.
 class BufPageManager {
 private:
-    int last;
-    HashMap *hash;
-    MultiList *list;
-    FindReplace *replace;
-    int id2key[BUF_CAPACITY][2];
-    bool dirty[BUF_CAPACITY];
+    struct Shard {
+        int base; // index of the first frame
+        int last;
+        HashMap *hash;
+        MultiList *list;
+        MultiList *dirtyList; // dirty frames of each file
+        ReplacePolicy *replace;
+        int dirtyCount, missCount, flushWindow;
+        int used; // frames holding a page
+        // statistics
+        long long hits, misses, reads, cleanEvictions, dirtyEvictions;
+        int residentPages[MAX_FILE_NUM], dirtyPages[MAX_FILE_NUM];
+        // protects everything above, and the frames of the shard
+        std::mutex latch;
+    };
+
+    int cap;
+    int shardNum, shardCap;
+    Shard *shards;
+    bool *dirty;
+    bool *prefetched; // read ahead and not referenced yet
+    int *pinCount;
     char *buf;
+    size_t bufSize;
+    bool bufMapped;
     FileManager *fileManager;
 
+    // `ioLatch` is held by the flusher while writing, so no file is closed
+    // under it. It is taken before any shard latch, and the shard latches
+    // are taken in ascending order.
+    std::mutex ioLatch;
+    std::mutex flushLatch;
+    std::condition_variable flushCond;
+    std::thread flusher;
+    bool flushRequested, stopFlusher;
+    char *flushBuf;
+    std::atomic<long long> foregroundWrites, backgroundWrites;
+
+    // sequential access detection of each file, protected by `readAheadLatch`
+    struct ReadAhead {
+        int last;   // the page requested last
+        int window; // pages to read ahead next time, 0 if not sequential
+        int next;   // the first page not read ahead yet
+    };
+    ReadAhead readAhead[MAX_FILE_NUM];
+    std::mutex readAheadLatch;
+    int readAheadMax;
+    std::atomic<long long> readAheadPages, readAheadHits;
+
+    // Pages of each permanent file ID to load when the file is opened, taken
+    // at closeFile. `warmer` loads them in the background, one job per file.
+    struct WarmJob {
+        int fileID, generation;
+        std::vector<int> pages;
+    };
+    // bumped by closeFile to cancel the jobs of the file, under `ioLatch`
+    int warmGeneration[MAX_FILE_NUM];
+    std::map<int, std::vector<int>> warmPages;
+    std::deque<WarmJob> warmJobs;
+    std::mutex warmLatch;
+    std::condition_variable warmCond;
+    std::thread warmer;
+    bool stopWarmer;
+    std::atomic<long long> warmedPages;
+
+    std::atomic<long long> checksumPages, checksumFailures, checksumNanos;
+
+    struct Config {
+        ReplacePolicyType policy = RP_LRU;
+        int capacity = BUF_CAPACITY;
+        double flushFraction = 0.05;
+        int readAheadMax = 64;
+        bool directIO = false;
+        int shards = 8;
+        bool warmUp = false;
+        bool bestEffortReads = false;
+    };
+
+    static Config &config() {
+        static Config conf;
+        return conf;
+    }
+
     char *getBuf(int index) {
-        return buf + index * PAGE_SIZE;
+        return buf + (size_t) index * PAGE_SIZE;
     }
 
-    int fetchPage(int fileID, int pageID) {
-        int index = replace->find();
-        if (dirty[index]) {
-            int k1, k2;
-            hash->getKeys(index, k1, k2);
-            fileManager->writePage(k1, k2, getBuf(index));
-            dirty[index] = false;
+    Shard &shardOfFrame(int index) {
+        assert(0 <= index && index < cap);
+        return shards[index / shardCap];
+    }
+
+    int shardOfPage(int fileID, int pageID) {
+        uint64_t key = (uint64_t) ReplacePolicy::pageKey(fileID, pageID);
+        return (int) (((key * 0x9E3779B97F4A7C15ull) >> 32) % (uint64_t) shardNum);
+    }
+
+    static ReplacePolicy *makePolicy(int c) {
+        switch (config().policy) {
+            case RP_2Q:
+                return new TwoQReplace(c);
+            case RP_CLOCK_PRO:
+                return new ClockProReplace(c);
+            default:
+                return new FindReplace(c);
+        }
+    }
+
+    // Try 2MB huge pages first to save TLB entries, then transparent huge
+    // pages, and fall back to the heap if mmap is not available at all.
+    void allocBuf() {
+        bufSize = (size_t) cap * PAGE_SIZE;
+        bufMapped = false;
+#ifdef __linux__
+        size_t hugeSize = (bufSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void *p = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            bufSize = hugeSize;
+        } else {
+            p = mmap(nullptr, bufSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (p != MAP_FAILED) {
+                madvise(p, bufSize, MADV_HUGEPAGE);
+            }
+#endif
+        }
+        if (p != MAP_FAILED) {
+            buf = (char *) p;
+            bufMapped = true;
+            return;
+        }
+#endif
+        buf = alignedAlloc(bufSize);
+    }
+
+    void freeBuf() {
+        if (bufMapped) {
+            munmap(buf, bufSize);
+        } else {
+            free(buf);
+        }
+    }
+
+    // frames may be read and written with O_DIRECT
+    static char *alignedAlloc(size_t size) {
+        void *p;
+        if (posix_memalign(&p, DIRECT_IO_ALIGN, size) != 0) {
+            throw std::bad_alloc();
+        }
+        return (char *) p;
+    }
+
+    // an I/O error leaves the buffer and the files inconsistent, give up
+    static void checkIO(int ret) {
+        if (ret != 0) {
+            fprintf(stderr, "Fatal: page I/O failed, aborting\n");
+            abort();
+        }
+    }
+
+    static uint32_t storedChecksum(const char *page) {
+        uint32_t checksum;
+        memcpy(&checksum, page + PAGE_SIZE - PAGE_CHECKSUM_SIZE, PAGE_CHECKSUM_SIZE);
+        return checksum;
+    }
+
+    static uint32_t pageChecksum(const char *page) {
+        return Crc32c::compute(page, PAGE_SIZE - PAGE_CHECKSUM_SIZE);
+    }
+
+    static long long nanosSince(std::chrono::steady_clock::time_point start) {
+        return (long long) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    // every page goes to the disk with its checksum
+    void writePages(int fileID, int count, const int *pageIDs, char *const *bufs) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) {
+            setChecksum(bufs[i]);
+        }
+        checksumNanos += nanosSince(start);
+        checksumPages += count;
+        checkIO(fileManager->writePages(fileID, count, pageIDs, bufs));
+    }
+
+    // A page read with a wrong checksum was torn by a crash while being
+    // written, or corrupted on the disk. Count and report it, and return
+    // false unless the reads are best-effort.
+    bool checkRead(int fileID, int pageID, const char *page) {
+        if (verifyChecksum(page)) {
+            return true;
+        }
+        checksumFailures++;
+        fprintf(stderr, "Checksum mismatch: page %d of file %d\n", pageID, fileID);
+        return config().bestEffortReads;
+    }
+
+    // bad[i] is set if page i failed checkRead
+    void readPages(int fileID, int count, const int *pageIDs, char *const *bufs, std::vector<bool> &bad) {
+        checkIO(fileManager->readPages(fileID, count, pageIDs, bufs));
+        auto start = std::chrono::steady_clock::now();
+        bad.assign((size_t) count, false);
+        for (int i = 0; i < count; i++) {
+            bad[i] = !checkRead(fileID, pageIDs[i], bufs[i]);
+        }
+        checksumNanos += nanosSince(start);
+        checksumPages += count;
+    }
+
+    // Free the frames of the pages read bad, so that they are read again
+    // when asked for. The latches of their shards are held and the frames
+    // are not pinned. Return whether any was bad.
+    bool dropBadLocked(const std::vector<int> &frames, const std::vector<bool> &bad) {
+        bool any = false;
+        for (size_t i = 0; i < frames.size(); i++) {
+            if (bad[i]) {
+                releaseLocked(shardOfFrame(frames[i]), frames[i]);
+                any = true;
+            }
+        }
+        return any;
+    }
+
+    // lock the shards in `ids`, which are sorted and unique
+    void lockShards(const std::vector<int> &ids, std::vector<std::unique_lock<std::mutex>> &locks) {
+        for (int id : ids) {
+            locks.emplace_back(shards[id].latch);
+        }
+    }
+
+    void lockAll(std::vector<std::unique_lock<std::mutex>> &locks) {
+        for (int i = 0; i < shardNum; i++) {
+            locks.emplace_back(shards[i].latch);
+        }
+    }
+
+    void getKeys(int index, int &fileID, int &pageID) {
+        Shard &s = shardOfFrame(index);
+        s.hash->getKeys(index - s.base, fileID, pageID);
+    }
+
+    // return -1 if the page is not in the shard
+    int findLocked(Shard &s, int fileID, int pageID) {
+        int local = s.hash->findIndex(fileID, pageID);
+        return local == -1 ? -1 : s.base + local;
+    }
+
+    // pages are sorted (fileID, pageID) pairs, the content of pages[i] is
+    // in bufs[i]. Consecutive pages go to the disk in one system call.
+    void writeSorted(const std::vector<std::pair<int, int>> &pages, const std::vector<char *> &bufs) {
+        std::vector<int> pageIDs;
+        for (size_t i = 0, j; i < pages.size(); i = j) {
+            pageIDs.clear();
+            for (j = i; j < pages.size() && pages[j].first == pages[i].first; j++) {
+                pageIDs.push_back(pages[j].second);
+            }
+            writePages(pages[i].first, (int) (j - i), pageIDs.data(), bufs.data() + i);
+        }
+    }
+
+    void setDirtyLocked(Shard &s, int index, bool isDirty) {
+        if (dirty[index] == isDirty) {
+            return;
+        }
+        dirty[index] = isDirty;
+        if (isDirty) {
+            int f, p;
+            s.hash->getKeys(index - s.base, f, p);
+            s.dirtyList->insert(f, index - s.base);
+            s.dirtyCount++;
+            s.dirtyPages[f]++;
+        } else {
+            int f, p;
+            s.hash->getKeys(index - s.base, f, p);
+            s.dirtyList->erase(index - s.base);
+            s.dirtyCount--;
+            s.dirtyPages[f]--;
+        }
+    }
+
+    void dirtyFramesLocked(Shard &s, int fileID, std::vector<int> &out) {
+        MultiList *l = s.dirtyList;
+        for (int local = l->getFirst(fileID); !l->isHead(local); local = l->next(local)) {
+            out.push_back(s.base + local);
+        }
+    }
+
+    // Write the dirty frames among `frames` in the order of (fileID, pageID),
+    // the latches of their shards are held.
+    void writeFramesLocked(const std::vector<int> &frames) {
+        std::vector<std::pair<std::pair<int, int>, int>> order;
+        for (int index : frames) {
+            if (dirty[index]) {
+                int f, p;
+                getKeys(index, f, p);
+                order.push_back(std::make_pair(std::make_pair(f, p), index));
+            }
+        }
+        std::sort(order.begin(), order.end());
+        std::vector<std::pair<int, int>> pages;
+        std::vector<char *> bufs;
+        for (const auto &item : order) {
+            pages.push_back(item.first);
+            bufs.push_back(getBuf(item.second));
+            setDirtyLocked(shardOfFrame(item.second), item.second, false);
+        }
+        writeSorted(pages, bufs);
+        foregroundWrites += pages.size();
+    }
+
+    void requestFlush() {
+        std::lock_guard<std::mutex> lock(flushLatch);
+        flushRequested = true;
+        flushCond.notify_one();
+    }
+
+    // a frame of the shard for the page, -1 if they are all pinned
+    int fetchPage(Shard &s, int fileID, int pageID) {
+        int local = s.replace->find();
+        if (local == -1) return -1;
+        int index = s.base + local;
+        bool wasDirty = dirty[index];
+        int k1, k2;
+        s.hash->getKeys(local, k1, k2);
+        if (k1 != -1) {
+            s.residentPages[k1]--;
+            s.used--;
+            (wasDirty ? s.dirtyEvictions : s.cleanEvictions)++;
+        }
+        if (wasDirty || prefetched[index]) {
+            if (wasDirty) {
+                char *page = getBuf(index);
+                writePages(k1, 1, &k2, &page);
+                setDirtyLocked(s, index, false);
+                foregroundWrites++;
+            }
+            if (prefetched[index]) {
+                // read ahead for nothing, be less eager on that file
+                prefetched[index] = false;
+                std::lock_guard<std::mutex> lock(readAheadLatch);
+                ReadAhead &ra = readAhead[k1];
+                if (ra.window > READ_AHEAD_MIN) {
+                    ra.window /= 2;
+                }
+            }
+        }
+        // wake the flusher up now and then, and at once if it falls behind
+        if (flusher.joinable() && (wasDirty || ++s.missCount % 32 == 0)) {
+            requestFlush();
+        }
+        s.hash->replace(local, fileID, pageID);
+        s.list->insert(fileID, local);
+        s.residentPages[fileID]++;
+        s.used++;
+        s.replace->load(local, ReplacePolicy::pageKey(fileID, pageID));
+        // the access right after loading is not a re-reference
+        s.last = index;
+        return index;
+    }
+
+    char *accessLocked(Shard &s, int index) {
+        if (index != s.last) {
+            s.replace->access(index - s.base);
+            s.last = index;
         }
-        hash->replace(index, fileID, pageID);
-        list->insert(fileID, index);
+        return getBuf(index);
+    }
+
+    // Track the pages requested from `fileID`. Once they are sequential,
+    // return in [from, to) the next window of pages to read ahead when the
+    // scan gets to the middle of the pages read ahead last time.
+    void readAheadRange(int fileID, int pageID, int &from, int &to) {
+        from = to = 0;
+        if (readAheadMax == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(readAheadLatch);
+        ReadAhead &ra = readAhead[fileID];
+        if (pageID == ra.last) {
+            return;
+        }
+        bool trigger = false;
+        if (pageID == ra.last + 1) {
+            if (ra.window == 0) {
+                ra.window = std::min(READ_AHEAD_MIN, readAheadMax);
+                ra.next = pageID + 1;
+            }
+            trigger = ra.next - pageID <= ra.window / 2;
+        } else {
+            ra.window = 0;
+        }
+        ra.last = pageID;
+        if (trigger) {
+            from = std::max(ra.next, pageID + 1);
+            to = std::min(from + std::min(ra.window, cap / 8), fileManager->getPageCount(fileID));
+            ra.next = std::max(ra.next, to);
+            ra.window = std::min(ra.window * 2, readAheadMax);
+        }
+    }
+
+    // Find or load the page, together with the pages in [from, to) not in
+    // the buffer. All of them are read in one readPages. The latches of the
+    // shards of all these pages are held.
+    int getPageLocked(int fileID, int pageID, int from, int to) {
+        Shard &s = shards[shardOfPage(fileID, pageID)];
+        int index = findLocked(s, fileID, pageID);
+        bool miss = index == -1;
+        if (miss) {
+            s.misses++;
+            index = fetchPage(s, fileID, pageID);
+            if (index == -1) throw BufferFullError();
+        } else if (prefetched[index]) {
+            // the first reference of a page read ahead is not a re-reference
+            s.hits++;
+            prefetched[index] = false;
+            s.last = index;
+            readAheadHits++;
+        } else {
+            s.hits++;
+            accessLocked(s, index);
+        }
+        std::vector<int> pageIDs, frames, read;
+        std::vector<char *> bufs;
+        if (miss) {
+            pageIDs.push_back(pageID);
+            bufs.push_back(getBuf(index));
+            read.push_back(index);
+        }
+        if (from < to) {
+            // keep the frames from replacing each other before being read
+            pinLocked(s, index);
+            for (int p = from; p < to; p++) {
+                Shard &t = shards[shardOfPage(fileID, p)];
+                if (findLocked(t, fileID, p) != -1) continue;
+                if (t.replace->getPinnedCount() >= shardCap - 1) continue;
+                int frame = fetchPage(t, fileID, p);
+                pinLocked(t, frame);
+                prefetched[frame] = true;
+                frames.push_back(frame);
+                read.push_back(frame);
+                pageIDs.push_back(p);
+                bufs.push_back(getBuf(frame));
+            }
+            unpinLocked(s, index);
+            readAheadPages += frames.size();
+        }
+        std::vector<bool> bad;
+        if (!pageIDs.empty()) {
+            readPages(fileID, (int) pageIDs.size(), pageIDs.data(), bufs.data(), bad);
+            s.reads += pageIDs.size();
+        }
+        for (int frame : frames) {
+            unpinLocked(shardOfFrame(frame), frame);
+        }
+        // a bad page read ahead only fails when it is asked for
+        if (dropBadLocked(read, bad) && miss && bad[0]) {
+            throw ChecksumError(fileID, pageID);
+        }
+        // the page asked for is referenced next
+        s.last = index;
         return index;
     }
 
+    void releaseLocked(Shard &s, int index) {
+        assert(pinCount[index] == 0);
+        setDirtyLocked(s, index, false);
+        prefetched[index] = false;
+        int f, p;
+        s.hash->getKeys(index - s.base, f, p);
+        if (f != -1) {
+            s.residentPages[f]--;
+            s.used--;
+        }
+        s.replace->free(index - s.base);
+        s.hash->erase(index - s.base);
+        s.list->erase(index - s.base);
+    }
+
+    void writeBackLocked(Shard &s, int index) {
+        if (dirty[index]) {
+            int f, p;
+            s.hash->getKeys(index - s.base, f, p);
+            char *page = getBuf(index);
+            writePages(f, 1, &p, &page);
+            setDirtyLocked(s, index, false);
+            foregroundWrites++;
+        }
+        releaseLocked(s, index);
+    }
+
+    // the latches of all the shards are held
+    void releaseFileLocked(int fileID) {
+        for (int i = 0; i < shardNum; i++) {
+            Shard &s = shards[i];
+            while (!s.list->isHead(s.list->getFirst(fileID))) {
+                releaseLocked(s, s.base + s.list->getFirst(fileID));
+            }
+        }
+        std::lock_guard<std::mutex> lock(readAheadLatch);
+        readAhead[fileID] = ReadAhead{-1, 0, 0};
+    }
+
+    // the latches of all the shards are held
+    void residentPagesLocked(int fileID, std::vector<int> &out) {
+        for (int i = 0; i < shardNum; i++) {
+            Shard &s = shards[i];
+            for (int local = s.list->getFirst(fileID); !s.list->isHead(local); local = s.list->next(local)) {
+                int f, p;
+                s.hash->getKeys(local, f, p);
+                out.push_back(p);
+            }
+        }
+        std::sort(out.begin(), out.end());
+    }
+
+    // remember the pages of the file to load them when it is opened again
+    void rememberLocked(int fileID, bool keep) {
+        std::vector<int> pages;
+        if (keep) {
+            residentPagesLocked(fileID, pages);
+        }
+        int permID = fileManager->getFilePermID(fileID);
+        std::lock_guard<std::mutex> lock(warmLatch);
+        if (pages.empty()) {
+            warmPages.erase(permID);
+        } else {
+            warmPages[permID].swap(pages);
+        }
+    }
+
+    void loadWarmUpList() {
+        std::ifstream stm(WARM_UP_FILE);
+        int permID, pageID;
+        while (stm >> permID >> pageID) {
+            warmPages[permID].push_back(pageID);
+        }
+    }
+
+    void saveWarmUpList() {
+        std::lock_guard<std::mutex> lock(warmLatch);
+        if (warmPages.empty()) {
+            remove(WARM_UP_FILE);
+            return;
+        }
+        std::ofstream stm(WARM_UP_FILE);
+        for (const auto &item : warmPages) {
+            for (int pageID : item.second) {
+                stm << item.first << " " << pageID << "\n";
+            }
+        }
+    }
+
+    // Load `pages[from, to)` of the job, sorted, in one readPages. Only
+    // free frames are used, so a busy buffer is not disturbed. Return false
+    // if the file has been closed.
+    bool warmBatch(const WarmJob &job, size_t from, size_t to) {
+        std::lock_guard<std::mutex> ioLock(ioLatch);
+        if (warmGeneration[job.fileID] != job.generation) {
+            return false;
+        }
+        int fileID = job.fileID;
+        int pageCount = fileManager->getPageCount(fileID);
+        std::vector<int> ids;
+        for (size_t i = from; i < to; i++) {
+            ids.push_back(shardOfPage(fileID, job.pages[i]));
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        std::vector<std::unique_lock<std::mutex>> locks;
+        lockShards(ids, locks);
+        std::vector<int> pageIDs, frames;
+        std::vector<char *> bufs;
+        for (size_t i = from; i < to; i++) {
+            int p = job.pages[i];
+            Shard &t = shards[shardOfPage(fileID, p)];
+            if (p >= pageCount || t.used >= shardCap || findLocked(t, fileID, p) != -1) continue;
+            int frame = fetchPage(t, fileID, p);
+            pinLocked(t, frame);
+            frames.push_back(frame);
+            pageIDs.push_back(p);
+            bufs.push_back(getBuf(frame));
+        }
+        std::vector<bool> bad;
+        if (!pageIDs.empty()) {
+            readPages(fileID, (int) pageIDs.size(), pageIDs.data(), bufs.data(), bad);
+        }
+        for (int frame : frames) {
+            unpinLocked(shardOfFrame(frame), frame);
+        }
+        dropBadLocked(frames, bad);
+        warmedPages += frames.size();
+        return true;
+    }
+
+    void warmerLoop() {
+        while (true) {
+            WarmJob job;
+            {
+                std::unique_lock<std::mutex> lock(warmLatch);
+                warmCond.wait(lock, [this] { return stopWarmer || !warmJobs.empty(); });
+                if (stopWarmer) return;
+                job = std::move(warmJobs.front());
+                warmJobs.pop_front();
+            }
+            for (size_t i = 0; i < job.pages.size(); i += IO_VEC_MAX) {
+                {
+                    std::lock_guard<std::mutex> lock(warmLatch);
+                    if (stopWarmer) return;
+                }
+                if (!warmBatch(job, i, std::min(job.pages.size(), i + IO_VEC_MAX))) break;
+            }
+        }
+    }
+
+    // Write the dirty frames among the next `flushWindow` victims of the
+    // shard, in the order of (fileID, pageID). Return the number of pages
+    // written.
+    int flushTail(Shard &s) {
+        std::lock_guard<std::mutex> ioLock(ioLatch);
+        std::vector<int> frames;
+        std::vector<std::pair<std::pair<int, int>, int>> pages;
+        std::vector<std::pair<int, int>> keys;
+        std::vector<char *> bufs;
+        {
+            std::lock_guard<std::mutex> lock(s.latch);
+            s.replace->tail(s.flushWindow, frames);
+            for (int local : frames) {
+                int index = s.base + local;
+                if (dirty[index] && pinCount[index] == 0) {
+                    int f, p;
+                    s.hash->getKeys(local, f, p);
+                    pages.push_back(std::make_pair(std::make_pair(f, p), index));
+                    if (pages.size() == FLUSH_BATCH) break;
+                }
+            }
+            std::sort(pages.begin(), pages.end());
+            // take a copy, and keep the frame from being replaced and written
+            // by a query while the old content is on its way to the disk
+            for (size_t i = 0; i < pages.size(); i++) {
+                int index = pages[i].second;
+                pinLocked(s, index);
+                setDirtyLocked(s, index, false);
+                memcpy(flushBuf + i * PAGE_SIZE, getBuf(index), PAGE_SIZE);
+                keys.push_back(pages[i].first);
+                bufs.push_back(flushBuf + i * PAGE_SIZE);
+            }
+        }
+        writeSorted(keys, bufs);
+        backgroundWrites += keys.size();
+        std::lock_guard<std::mutex> lock(s.latch);
+        for (const auto &page : pages) {
+            unpinLocked(s, page.second);
+        }
+        return (int) pages.size();
+    }
+
+    void flusherLoop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(flushLatch);
+                flushCond.wait_for(lock, std::chrono::milliseconds(100),
+                                   [this] { return stopFlusher || flushRequested; });
+                if (stopFlusher) return;
+                flushRequested = false;
+            }
+            for (int i = 0; i < shardNum; i++) {
+                while (flushTail(shards[i]) == FLUSH_BATCH);
+            }
+            checkIO(fileManager->syncCompressed());
+        }
+    }
+
+    void pinLocked(Shard &s, int index) {
+        if (pinCount[index]++ == 0) {
+            s.replace->setEvictable(index - s.base, false);
+        }
+    }
+
+    void unpinLocked(Shard &s, int index) {
+        assert(pinCount[index] > 0);
+        if (--pinCount[index] == 0) {
+            s.replace->setEvictable(index - s.base, true);
+        }
+    }
+
     BufPageManager() {
-        buf = new char[BUF_CAPACITY * PAGE_SIZE];
+        // every shard gets the same number of frames, the rest is not used
+        shardNum = std::max(1, std::min(config().shards, config().capacity / SHARD_MIN_FRAMES));
+        shardCap = config().capacity / shardNum;
+        cap = shardCap * shardNum;
+        allocBuf();
         fileManager = new FileManager;
-        replace = new FindReplace();
-        hash = new HashMap(BUF_CAPACITY);
-        list = new MultiList(BUF_CAPACITY, MAX_FILE_NUM);
-        last = -1;
-        memset(dirty, 0, sizeof(dirty));
+        fileManager->setDirectIO(config().directIO);
+        double flushFraction = config().flushFraction;
+        shards = new Shard[shardNum];
+        for (int i = 0; i < shardNum; i++) {
+            Shard &s = shards[i];
+            s.base = i * shardCap;
+            s.last = -1;
+            s.hash = new HashMap(shardCap);
+            s.list = new MultiList(shardCap, MAX_FILE_NUM);
+            s.dirtyList = new MultiList(shardCap, MAX_FILE_NUM);
+            s.replace = makePolicy(shardCap);
+            s.dirtyCount = s.missCount = s.used = 0;
+            s.hits = s.misses = s.reads = s.cleanEvictions = s.dirtyEvictions = 0;
+            memset(s.residentPages, 0, sizeof(s.residentPages));
+            memset(s.dirtyPages, 0, sizeof(s.dirtyPages));
+            s.flushWindow = (int) (shardCap * flushFraction);
+        }
+        dirty = new bool[cap];
+        prefetched = new bool[cap];
+        pinCount = new int[cap];
+        memset(dirty, 0, sizeof(bool) * cap);
+        memset(prefetched, 0, sizeof(bool) * cap);
+        memset(pinCount, 0, sizeof(int) * cap);
+        foregroundWrites = backgroundWrites = 0;
+        flushRequested = stopFlusher = false;
+        readAheadMax = config().readAheadMax;
+        readAheadPages = readAheadHits = 0;
+        warmedPages = 0;
+        checksumPages = checksumFailures = checksumNanos = 0;
+        stopWarmer = false;
+        memset(warmGeneration, 0, sizeof(warmGeneration));
+        if (config().warmUp) {
+            loadWarmUpList();
+        }
+        for (int i = 0; i < MAX_FILE_NUM; i++) {
+            readAhead[i] = ReadAhead{-1, 0, 0};
+        }
+        flushBuf = nullptr;
+        if (shards[0].flushWindow > 0) {
+            flushBuf = alignedAlloc((size_t) FLUSH_BATCH * PAGE_SIZE);
+            flusher = std::thread(&BufPageManager::flusherLoop, this);
+        }
     }
 
     BufPageManager(BufPageManager const &);
@@ -48,14 +816,123 @@ private:
     BufPageManager &operator=(BufPageManager const &);
 
     ~BufPageManager() {
-        delete replace;
-        delete hash;
-        delete list;
+        if (flusher.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(flushLatch);
+                stopFlusher = true;
+            }
+            flushCond.notify_one();
+            flusher.join();
+        }
+        if (warmer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(warmLatch);
+                stopWarmer = true;
+            }
+            warmCond.notify_one();
+            warmer.join();
+        }
+        if (config().warmUp) {
+            saveWarmUpList();
+        }
+        free(flushBuf);
+        for (int i = 0; i < shardNum; i++) {
+            delete shards[i].replace;
+            delete shards[i].hash;
+            delete shards[i].list;
+            delete shards[i].dirtyList;
+        }
+        delete[] shards;
         delete fileManager;
-        delete buf;
+        delete[] dirty;
+        delete[] prefetched;
+        delete[] pinCount;
+        freeBuf();
     }
 
 public:
+    // must be called before the first getInstance()
+    static void setReplacePolicy(ReplacePolicyType policy) {
+        config().policy = policy;
+    }
+
+    // number of frames, must be called before the first getInstance()
+    static void setCapacity(int capacity) {
+        assert(capacity > 0);
+        config().capacity = capacity;
+    }
+
+    // The flusher keeps this fraction of the frames closest to being replaced
+    // clean, 0 to disable it. Must be called before the first getInstance().
+    static void setFlushFraction(double fraction) {
+        assert(0 <= fraction && fraction <= 1);
+        config().flushFraction = fraction;
+    }
+
+    // largest number of pages read ahead at once in a sequential scan, 0 to
+    // disable read-ahead. Must be called before the first getInstance().
+    static void setReadAhead(int pages) {
+        assert(pages >= 0);
+        config().readAheadMax = pages;
+    }
+
+    // open the files with O_DIRECT so that the pages are not cached twice,
+    // must be called before the first getInstance()
+    static void setDirectIO(bool direct) {
+        config().directIO = direct;
+    }
+
+    // Number of shards of the buffer, fewer when the buffer is too small to
+    // give each SHARD_MIN_FRAMES frames. Must be called before the first
+    // getInstance().
+    static void setShards(int n) {
+        assert(n > 0);
+        config().shards = n;
+    }
+
+    // Remember the pages in the buffer when the files are closed, and load
+    // them again in the background when the files are opened, also after a
+    // restart. Off by default, the list is kept in WARM_UP_FILE in the
+    // working directory. Must be called before the first getInstance().
+    static void setWarmUp(bool warmUp) {
+        config().warmUp = warmUp;
+    }
+
+    // Serve the pages read with a wrong checksum as they are, after
+    // reporting them on stderr, instead of throwing ChecksumError. Meant for
+    // getting what is left of a damaged table.
+    static void setBestEffortReads(bool bestEffort) {
+        config().bestEffortReads = bestEffort;
+    }
+
+    // The checksum is kept in the last PAGE_CHECKSUM_SIZE bytes of the page,
+    // which are not part of its content. Pages written around the buffer
+    // need it too.
+    static void setChecksum(char *page) {
+        uint32_t checksum = pageChecksum(page);
+        memcpy(page + PAGE_SIZE - PAGE_CHECKSUM_SIZE, &checksum, PAGE_CHECKSUM_SIZE);
+    }
+
+    // a page of zeros was never written and has no checksum
+    static bool verifyChecksum(const char *page) {
+        if (storedChecksum(page) == pageChecksum(page)) {
+            return true;
+        }
+        return page[0] == 0 && memcmp(page, page + 1, PAGE_SIZE - 1) == 0;
+    }
+
+    // Verify a page read around the buffer, e.g. from a mapped file, and
+    // throw ChecksumError as a page read through the buffer would.
+    void verifyPage(int fileID, int pageID, const char *page) {
+        auto start = std::chrono::steady_clock::now();
+        bool good = checkRead(fileID, pageID, page);
+        checksumNanos += nanosSince(start);
+        checksumPages++;
+        if (!good) {
+            throw ChecksumError(fileID, pageID);
+        }
+    }
+
     static BufPageManager &getInstance() {
         static BufPageManager instance;
         return instance;
@@ -65,73 +942,271 @@ public:
         return *(getInstance().fileManager);
     }
 
-    int allocPage(int fileID, int pageID, bool ifRead = false) {
-        int index = fetchPage(fileID, pageID);
+    int getCapacity() {
+        return cap;
+    }
+
+    int getShardCount() {
+        return shardNum;
+    }
+
+    // load the pages of the file that were in the buffer when it was closed
+    // last time, in the background and in page order
+    void warmUp(int fileID) {
+        if (!config().warmUp) {
+            return;
+        }
+        WarmJob job;
+        job.fileID = fileID;
+        {
+            std::lock_guard<std::mutex> ioLock(ioLatch);
+            job.generation = warmGeneration[fileID];
+        }
+        int permID = fileManager->getFilePermID(fileID);
+        std::lock_guard<std::mutex> lock(warmLatch);
+        auto it = warmPages.find(permID);
+        if (it == warmPages.end()) {
+            return;
+        }
+        job.pages = it->second;
+        std::sort(job.pages.begin(), job.pages.end());
+        warmJobs.push_back(std::move(job));
+        if (!warmer.joinable()) {
+            warmer = std::thread(&BufPageManager::warmerLoop, this);
+        }
+        warmCond.notify_one();
+    }
+
+    // A frame for the page, read from the file if `ifRead`, and pinned before
+    // any other thread can replace it if `pin`. Throw BufferFullError if all
+    // the frames of its shard are pinned, and ChecksumError if the page is
+    // read bad, as getPage and pinPage do.
+    int allocPage(int fileID, int pageID, bool ifRead = false, bool pin = false) {
+        Shard &s = shards[shardOfPage(fileID, pageID)];
+        std::lock_guard<std::mutex> lock(s.latch);
+        int index = fetchPage(s, fileID, pageID);
+        if (index == -1) throw BufferFullError();
         if (ifRead) {
-            fileManager->readPage(fileID, pageID, getBuf(index));
+            char *page = getBuf(index);
+            std::vector<bool> bad;
+            readPages(fileID, 1, &pageID, &page, bad);
+            s.reads++;
+            if (dropBadLocked(std::vector<int>(1, index), bad)) {
+                throw ChecksumError(fileID, pageID);
+            }
+        }
+        if (pin) {
+            pinLocked(s, index);
         }
         return index;
     }
 
+    // The index is valid until the next page fetch in this thread. With more
+    // threads, use pinPage or a PageGuard to keep it.
     int getPage(int fileID, int pageID) {
-        int index = hash->findIndex(fileID, pageID);
-        if (index != -1) {
-            access(index);
-        } else {
-            index = fetchPage(fileID, pageID);
-            fileManager->readPage(fileID, pageID, getBuf(index));
+        return pinPage(fileID, pageID, false);
+    }
+
+    // get the page and pin it before any other thread can replace it
+    int pinPage(int fileID, int pageID, bool pin = true) {
+        int from, to;
+        readAheadRange(fileID, pageID, from, to);
+        std::vector<int> ids(1, shardOfPage(fileID, pageID));
+        for (int p = from; p < to; p++) {
+            ids.push_back(shardOfPage(fileID, p));
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        std::vector<std::unique_lock<std::mutex>> locks;
+        lockShards(ids, locks);
+        int index = getPageLocked(fileID, pageID, from, to);
+        if (pin) {
+            pinLocked(shardOfFrame(index), index);
         }
         return index;
     }
 
     char *access(int index) {
-        if (index != last) {
-            replace->access(index);
-            last = index;
-        }
-        return getBuf(index);
+        Shard &s = shardOfFrame(index);
+        std::lock_guard<std::mutex> lock(s.latch);
+        return accessLocked(s, index);
     }
 
     void markDirty(int index) {
-        dirty[index] = true;
-        access(index);
+        Shard &s = shardOfFrame(index);
+        std::lock_guard<std::mutex> lock(s.latch);
+        setDirtyLocked(s, index, true);
+        accessLocked(s, index);
+    }
+
+    // a pinned frame is never chosen to be replaced
+    void pin(int index) {
+        Shard &s = shardOfFrame(index);
+        std::lock_guard<std::mutex> lock(s.latch);
+        pinLocked(s, index);
+    }
+
+    void unpin(int index) {
+        Shard &s = shardOfFrame(index);
+        std::lock_guard<std::mutex> lock(s.latch);
+        unpinLocked(s, index);
     }
 
     // withdraw without writeback
     void release(int index) {
-        dirty[index] = false;
-        replace->free(index);
-        hash->erase(index);
-        list->erase(index);
+        std::lock_guard<std::mutex> ioLock(ioLatch);
+        Shard &s = shardOfFrame(index);
+        std::lock_guard<std::mutex> lock(s.latch);
+        releaseLocked(s, index);
     }
 
     void writeBack(int index) {
-        if (dirty[index]) {
-            int f, p;
-            hash->getKeys(index, f, p);
-            fileManager->writePage(f, p, getBuf(index));
-            dirty[index] = false;
-        }
-        replace->free(index);
-        hash->erase(index);
-        list->erase(index);
+        std::lock_guard<std::mutex> ioLock(ioLatch);
+        Shard &s = shardOfFrame(index);
+        std::lock_guard<std::mutex> lock(s.latch);
+        writeBackLocked(s, index);
     }
 
+    // Write the dirty pages of the file in ascending page order, and drop
+    // all its pages from the buffer. Only the dirty frames are looked at
+    // for writing.
     void closeFile(int fileID, bool ifWrite = true) {
-        int index;
-        while (!list->isHead(index = list->getFirst(fileID))) {
-            if (ifWrite) {
-                writeBack(index);
-            } else {
-                release(index);
+        std::lock_guard<std::mutex> ioLock(ioLatch);
+        std::vector<std::unique_lock<std::mutex>> locks;
+        lockAll(locks);
+        warmGeneration[fileID]++;
+        if (config().warmUp) {
+            rememberLocked(fileID, ifWrite);
+        }
+        if (ifWrite) {
+            std::vector<int> frames;
+            for (int i = 0; i < shardNum; i++) {
+                dirtyFramesLocked(shards[i], fileID, frames);
             }
+            writeFramesLocked(frames);
         }
+        releaseFileLocked(fileID);
+    }
+
+    // Drop the pages of the file from `pageCount` on from the buffer without
+    // writing them, and cut the file there. None of them may be pinned.
+    void truncateFile(int fileID, int pageCount) {
+        std::lock_guard<std::mutex> ioLock(ioLatch);
+        std::vector<std::unique_lock<std::mutex>> locks;
+        lockAll(locks);
+        for (int i = 0; i < shardNum; i++) {
+            Shard &s = shards[i];
+            std::vector<int> frames;
+            for (int local = s.list->getFirst(fileID); !s.list->isHead(local); local = s.list->next(local)) {
+                int f, p;
+                s.hash->getKeys(local, f, p);
+                if (p >= pageCount) frames.push_back(s.base + local);
+            }
+            for (int index : frames) releaseLocked(s, index);
+        }
+        {
+            std::lock_guard<std::mutex> lock(readAheadLatch);
+            readAhead[fileID] = ReadAhead{-1, 0, 0};
+        }
+        checkIO(fileManager->truncateFile(fileID, pageCount));
+    }
+
+    // write all the dirty pages and keep them in the buffer
+    void checkpoint() {
+        std::lock_guard<std::mutex> ioLock(ioLatch);
+        std::vector<std::unique_lock<std::mutex>> locks;
+        lockAll(locks);
+        std::vector<int> frames;
+        for (int i = 0; i < shardNum; i++) {
+            for (int f = 0; f < MAX_FILE_NUM; f++) {
+                dirtyFramesLocked(shards[i], f, frames);
+            }
+        }
+        writeFramesLocked(frames);
+        checkIO(fileManager->syncCompressed());
     }
 
     void close() {
-        for (int i = 0; i < BUF_CAPACITY; ++i) {
-            writeBack(i);
+        std::lock_guard<std::mutex> ioLock(ioLatch);
+        std::vector<std::unique_lock<std::mutex>> locks;
+        lockAll(locks);
+        std::vector<int> frames;
+        for (int i = 0; i < shardNum; i++) {
+            for (int f = 0; f < MAX_FILE_NUM; f++) {
+                dirtyFramesLocked(shards[i], f, frames);
+            }
+        }
+        writeFramesLocked(frames);
+        for (int f = 0; f < MAX_FILE_NUM; f++) {
+            warmGeneration[f]++;
+            if (config().warmUp && fileManager->isOpen[f]) {
+                rememberLocked(f, true);
+            }
+            releaseFileLocked(f);
         }
+        if (config().warmUp) {
+            saveWarmUpList();
+        }
+    }
+
+    int getDirtyCount() {
+        int count = 0;
+        for (int i = 0; i < shardNum; i++) {
+            std::lock_guard<std::mutex> lock(shards[i].latch);
+            count += shards[i].dirtyCount;
+        }
+        return count;
+    }
+
+    // the shards are locked one by one, the counters of a busy buffer may
+    // be a little off from each other
+    void getStats(BufferStats &stats) {
+        memset(&stats, 0, sizeof(stats));
+        stats.capacity = cap;
+        stats.shards = shardNum;
+        for (int i = 0; i < shardNum; i++) {
+            Shard &s = shards[i];
+            std::lock_guard<std::mutex> lock(s.latch);
+            stats.used += s.used;
+            stats.pinned += s.replace->getPinnedCount();
+            stats.dirty += s.dirtyCount;
+            stats.hits += s.hits;
+            stats.misses += s.misses;
+            stats.reads += s.reads;
+            stats.cleanEvictions += s.cleanEvictions;
+            stats.dirtyEvictions += s.dirtyEvictions;
+            for (int f = 0; f < MAX_FILE_NUM; f++) {
+                stats.residentPages[f] += s.residentPages[f];
+                stats.dirtyPages[f] += s.dirtyPages[f];
+            }
+        }
+        stats.foregroundWrites = foregroundWrites;
+        stats.backgroundWrites = backgroundWrites;
+        stats.readAheadPages = readAheadPages;
+        stats.readAheadHits = readAheadHits;
+        stats.warmedPages = warmedPages;
+        stats.checksumPages = checksumPages;
+        stats.checksumFailures = checksumFailures;
+        stats.checksumNanos = checksumNanos;
+    }
+
+    // pages written when replacing or closing, i.e. on the query path
+    long long getForegroundWrites() {
+        return foregroundWrites;
+    }
+
+    // pages written by the flusher
+    long long getBackgroundWrites() {
+        return backgroundWrites;
+    }
+
+    // pages read ahead, and how many of them were used before being replaced
+    long long getReadAheadPages() {
+        return readAheadPages;
+    }
+
+    long long getReadAheadHits() {
+        return readAheadHits;
     }
 };
 
@@ -0,0 +1,280 @@
+#ifndef __CLOCK_PRO_REPLACE_H__
+#define __CLOCK_PRO_REPLACE_H__
+
+#include <vector>
+#include <unordered_map>
+#include "ReplacePolicy.h"
+
+// CLOCK-Pro (Jiang, Chen & Zhang, USENIX ATC'05).
+// Resident hot pages, resident cold pages and non-resident cold pages still
+// in their test period share one clock. Node [0, cap) are the frames, node
+// [cap, 2 * cap] hold the non-resident pages. New pages are inserted right
+// behind handHot, i.e. at the head of the list.
+// Frames freed by BufPageManager are handed out before running handCold.
+class ClockProReplace : public ReplacePolicy {
+private:
+    int cap;
+    int coldTarget;
+    int hotCount, coldCount, ghostCount;
+    int handHot, handCold, handTest;
+    std::vector<int> prev, next;
+    std::vector<long long> keys;
+    std::vector<bool> hot, ref, test, linked, vacant;
+    std::vector<int> freeFrames, freeGhosts;
+    std::unordered_map<long long, int> ghost;
+
+    bool isGhost(int n) {
+        return n >= cap;
+    }
+
+    void insertHead(int n) {
+        linked[n] = true;
+        if (handHot == -1) {
+            prev[n] = next[n] = n;
+            handHot = handCold = handTest = n;
+            return;
+        }
+        int p = prev[handHot];
+        next[p] = n;
+        prev[n] = p;
+        next[n] = handHot;
+        prev[handHot] = n;
+    }
+
+    void unlink(int n) {
+        linked[n] = false;
+        if (next[n] == n) {
+            handHot = handCold = handTest = -1;
+            return;
+        }
+        if (handHot == n) handHot = next[n];
+        if (handCold == n) handCold = next[n];
+        if (handTest == n) handTest = next[n];
+        next[prev[n]] = next[n];
+        prev[next[n]] = prev[n];
+    }
+
+    // put `g` at the position of `n` in the clock
+    void substitute(int n, int g) {
+        linked[g] = true;
+        linked[n] = false;
+        if (next[n] == n) {
+            prev[g] = next[g] = g;
+        } else {
+            prev[g] = prev[n];
+            next[g] = next[n];
+            next[prev[n]] = g;
+            prev[next[n]] = g;
+        }
+        if (handHot == n) handHot = g;
+        if (handCold == n) handCold = g;
+        if (handTest == n) handTest = g;
+    }
+
+    void dropGhost(int g) {
+        unlink(g);
+        ghost.erase(keys[g]);
+        freeGhosts.push_back(g);
+        ghostCount--;
+    }
+
+    void shrinkCold() {
+        if (coldTarget > 1) coldTarget--;
+    }
+
+    void growCold() {
+        if (coldTarget < cap - 1) coldTarget++;
+    }
+
+    void runHandHot() {
+        while (hotCount > 0) {
+            int n = handHot;
+            handHot = next[n];
+            if (isGhost(n)) {
+                dropGhost(n);
+                shrinkCold();
+            } else if (hot[n]) {
+                if (ref[n]) {
+                    ref[n] = false;
+                } else {
+                    hot[n] = false;
+                    hotCount--;
+                    coldCount++;
+                    return;
+                }
+            } else if (test[n]) {
+                test[n] = false;
+                shrinkCold();
+            }
+        }
+    }
+
+    void runHandTest() {
+        while (ghostCount > 0) {
+            int n = handTest;
+            handTest = next[n];
+            if (isGhost(n)) {
+                dropGhost(n);
+                shrinkCold();
+                return;
+            }
+            if (!hot[n] && test[n]) {
+                test[n] = false;
+                shrinkCold();
+            }
+        }
+    }
+
+    void balanceHot() {
+        while (hotCount > 0 && hotCount > cap - coldTarget) {
+            runHandHot();
+        }
+    }
+
+    int runHandCold() {
+        while (coldCount == 0) {
+            runHandHot();
+        }
+        // two laps without a victim means all the cold pages are pinned
+        int idle = 0;
+        while (true) {
+            if (++idle > 4 * cap + 2) {
+                runHandHot();
+                idle = 0;
+            }
+            int n = handCold;
+            handCold = next[n];
+            if (isGhost(n) || hot[n] || pinned[n]) {
+                continue;
+            }
+            if (ref[n]) {
+                ref[n] = false;
+                if (test[n]) {
+                    test[n] = false;
+                    hot[n] = true;
+                    coldCount--;
+                    hotCount++;
+                    growCold();
+                    balanceHot();
+                } else {
+                    test[n] = true;
+                    unlink(n);
+                    insertHead(n);
+                }
+                if (coldCount == 0) {
+                    runHandHot();
+                }
+                continue;
+            }
+            coldCount--;
+            if (test[n]) {
+                int g = freeGhosts.back();
+                freeGhosts.pop_back();
+                keys[g] = keys[n];
+                test[g] = true;
+                substitute(n, g);
+                ghost[keys[g]] = g;
+                if (++ghostCount > cap) {
+                    runHandTest();
+                }
+            } else {
+                unlink(n);
+            }
+            return n;
+        }
+    }
+
+public:
+    // there are cap + 1 ghost nodes, as a new ghost is created before the
+    // oldest one gets dropped
+    ClockProReplace(int c) : ReplacePolicy(c), prev(2 * c + 1), next(2 * c + 1), keys(2 * c + 1), hot(2 * c + 1),
+                             ref(2 * c + 1), test(2 * c + 1), linked(2 * c + 1), vacant(c, true) {
+        cap = c;
+        coldTarget = cap / 4 > 0 ? cap / 4 : 1;
+        hotCount = coldCount = ghostCount = 0;
+        handHot = handCold = handTest = -1;
+        for (int i = cap - 1; i >= 0; i--) {
+            freeFrames.push_back(i);
+        }
+        for (int i = 2 * cap; i >= cap; i--) {
+            freeGhosts.push_back(i);
+        }
+    }
+
+    void free(int index) override {
+        if (linked[index]) {
+            if (hot[index]) {
+                hotCount--;
+            } else {
+                coldCount--;
+            }
+            unlink(index);
+        }
+        hot[index] = ref[index] = test[index] = false;
+        if (!vacant[index]) {
+            vacant[index] = true;
+            freeFrames.push_back(index);
+        }
+    }
+
+    void access(int index) override {
+        ref[index] = true;
+    }
+
+    void load(int index, long long key) override {
+        keys[index] = key;
+        ref[index] = false;
+        auto it = ghost.find(key);
+        if (it != ghost.end()) {
+            // re-accessed during its test period: the page deserves to be hot
+            dropGhost(it->second);
+            growCold();
+            hot[index] = true;
+            test[index] = false;
+            hotCount++;
+            insertHead(index);
+            balanceHot();
+        } else {
+            hot[index] = false;
+            test[index] = true;
+            coldCount++;
+            insertHead(index);
+        }
+    }
+
+    int find() override {
+        if (!freeFrames.empty()) {
+            int index = freeFrames.back();
+            freeFrames.pop_back();
+            vacant[index] = false;
+            return index;
+        }
+        if (hotCount + coldCount == pinnedCount) {
+            return -1;
+        }
+        return runHandCold();
+    }
+
+    // cold pages in front of handCold, the ones without reference bit first
+    void tail(int n, std::vector<int> &out) override {
+        if (handCold == -1) {
+            return;
+        }
+        size_t begin = out.size();
+        for (int pass = 0; pass < 2; pass++) {
+            int node = handCold;
+            do {
+                if (!isGhost(node) && !hot[node] && !pinned[node] && ref[node] == (pass == 1)) {
+                    out.push_back(node);
+                    if ((int) (out.size() - begin) == n) {
+                        return;
+                    }
+                }
+                node = next[node];
+            } while (node != handCold);
+        }
+    }
+
+};
+
+#endif
@@ -2,12 +2,31 @@
 #define __FILE_MANAGER_H__
 
 #include "../constants.h"
+#include "IoUring.h"
+#include "PageMap.h"
+#include "../util/Lz4.h"
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <map>
+#include <mutex>
 #include <fstream>
+#include <vector>
+
+// pages in one preadv/pwritev, no more than IOV_MAX
+#define IO_VEC_MAX 64
+// submission queue size of the shared io_uring
+#define IO_URING_ENTRIES 256
+// alignment of the buffers, offsets and lengths of O_DIRECT transfers
+#define DIRECT_IO_ALIGN 4096
 
 class FileManager {
     friend class BufPageManager;
@@ -16,10 +35,19 @@ class FileManager {
     int filePermID[MAX_FILE_NUM];
     int idStack[MAX_FILE_NUM];
     bool isOpen[MAX_FILE_NUM];
+    bool isDirect[MAX_FILE_NUM];
+    PageMap *pageMap[MAX_FILE_NUM]; // nullptr if the file is not compressed
+    // guards `pageMap` against syncCompressed from another thread
+    std::mutex mapLatch;
     int idStackTop;
     std::map<std::string, int> permID;
     std::map<int, int> perm2temp;
     int nextID;
+    bool directIO;
+#ifdef USE_IO_URING
+    IoUring ring;
+    bool useRing;
+#endif
 
     FileManager() {
         idStackTop = 0;
@@ -27,7 +55,14 @@ class FileManager {
             idStack[idStackTop++] = i;
         }
         memset(isOpen, 0, sizeof(isOpen));
+        memset(isDirect, 0, sizeof(isDirect));
+        memset(pageMap, 0, sizeof(pageMap));
         nextID = 0;
+        directIO = false;
+#ifdef USE_IO_URING
+        // fall back to preadv/pwritev when the kernel refuses
+        useRing = ring.init(IO_URING_ENTRIES);
+#endif
 
         std::ifstream stm("perm.id");
         if (stm.is_open()) {
@@ -47,35 +82,379 @@ class FileManager {
         }
     }
 
-public:
-    void writePage(int fileID, int pageID, char *buf) {
-        assert(0 <= fileID && fileID < MAX_FILE_NUM && isOpen[fileID]);
+    // Transfer the run of pages starting at `offset` described by `iov`,
+    // retrying on short transfers and EINTR. Return 0 on success, -1 on error.
+    static int transfer(int file, struct iovec *iov, int cnt, off_t offset, bool write) {
+        while (cnt > 0) {
+            ssize_t ret = write ? pwritev(file, iov, cnt, offset) : preadv(file, iov, cnt, offset);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            if (ret == 0) {
+                errno = EIO; // reading beyond the end of file
+                return -1;
+            }
+            offset += ret;
+            while (cnt > 0 && (size_t) ret >= iov->iov_len) {
+                ret -= iov->iov_len;
+                iov++;
+                cnt--;
+            }
+            if (cnt > 0) {
+                iov->iov_base = (char *) iov->iov_base + ret;
+                iov->iov_len -= ret;
+            }
+        }
+        return 0;
+    }
+
+    static int ioError(int fileID, int pageID, bool write) {
+        fprintf(stderr, "IO Error: %s page %d of file %d: %s\n", write ? "writing" : "reading",
+                pageID, fileID, strerror(errno));
+        return -1;
+    }
+
+#ifdef USE_IO_URING
+    // submit all the runs to the ring together so that they overlap,
+    // finish short transfers synchronously
+    int transferRing(int fileID, int count, const int *pageIDs, char *const *bufs, bool write) {
+        int file = fileList[fileID];
+        std::vector<struct iovec> iov((size_t) count);
+        std::vector<IoRun> runs;
+        std::vector<int> first;
+        for (int i = 0, j; i < count; i = j) {
+            for (j = i; j < count && j - i < IO_VEC_MAX && pageIDs[j] == pageIDs[i] + (j - i); j++) {
+                iov[j].iov_base = bufs[j];
+                iov[j].iov_len = PAGE_SIZE;
+            }
+            off_t offset = pageIDs[i];
+            offset <<= PAGE_IDX;
+            runs.push_back(IoRun{&iov[i], j - i, offset, 0});
+            first.push_back(i);
+        }
+        ring.transfer(file, runs.data(), (int) runs.size(), write);
+        for (size_t k = 0; k < runs.size(); k++) {
+            IoRun &run = runs[k];
+            if (run.result < 0) {
+                errno = (int) -run.result;
+                return ioError(fileID, pageIDs[first[k]], write);
+            }
+            size_t done = (size_t) run.result;
+            if (done == (size_t) run.cnt * PAGE_SIZE) continue;
+            if (done == 0) {
+                errno = EIO; // reading beyond the end of file
+                return ioError(fileID, pageIDs[first[k]], write);
+            }
+            struct iovec *rest = run.iov + done / PAGE_SIZE;
+            rest->iov_base = (char *) rest->iov_base + done % PAGE_SIZE;
+            rest->iov_len -= done % PAGE_SIZE;
+            if (transfer(file, rest, run.cnt - (int) (done / PAGE_SIZE), run.offset + (off_t) done, write) != 0) {
+                return ioError(fileID, pageIDs[first[k]], write);
+            }
+        }
+        return 0;
+    }
+#endif
+
+    // O_DIRECT needs aligned buffers, go through an aligned copy of the pages
+    int transferBounced(int fileID, int count, const int *pageIDs, char *const *bufs, bool write) {
+        void *mem;
+        if (posix_memalign(&mem, DIRECT_IO_ALIGN, (size_t) count * PAGE_SIZE) != 0) {
+            return ioError(fileID, pageIDs[0], write);
+        }
+        std::vector<char *> aligned((size_t) count);
+        for (int i = 0; i < count; i++) {
+            aligned[i] = (char *) mem + (size_t) i * PAGE_SIZE;
+            if (write) memcpy(aligned[i], bufs[i], PAGE_SIZE);
+        }
+        int ret = transferPages(fileID, count, pageIDs, aligned.data(), write);
+        if (ret == 0 && !write) {
+            for (int i = 0; i < count; i++) {
+                memcpy(bufs[i], aligned[i], PAGE_SIZE);
+            }
+        }
+        free(mem);
+        return ret;
+    }
+
+    // Each page of a compressed file is compressed into whole sectors, or
+    // kept as it is if that saves nothing. The pages next to each other on
+    // the disk, e.g. written back together, go in one preadv/pwritev.
+    // Written pages go to new sectors, see syncCompressed.
+    int transferCompressed(int fileID, int count, const int *pageIDs, char *const *bufs, bool write) {
+        PageMap &map = *pageMap[fileID];
+        std::vector<PageMap::Slot> slots((size_t) count);
+        std::vector<char> packed((size_t) count * PAGE_SIZE);
+        {
+            std::lock_guard<std::mutex> lock(map.latch);
+            for (int i = 0; i < count; i++) {
+                char *data = &packed[(size_t) i * PAGE_SIZE];
+                if (write) {
+                    int bytes = Lz4::compress(bufs[i], PAGE_SIZE, data, PAGE_SIZE - COMPRESS_SECTOR);
+                    if (bytes < 0) {
+                        memcpy(data, bufs[i], PAGE_SIZE);
+                        bytes = PAGE_SIZE;
+                    }
+                    slots[i] = map.place(pageIDs[i], bytes);
+                    memset(data + bytes, 0, (size_t) slots[i].sectors * COMPRESS_SECTOR - bytes);
+                } else if (map.find(pageIDs[i])) {
+                    slots[i] = *map.find(pageIDs[i]);
+                } else if (pageIDs[i] < map.pageCount()) {
+                    // reads as zeros, like a hole in a file
+                    slots[i] = PageMap::Slot{pageIDs[i], 0, 0, 0};
+                } else {
+                    errno = EIO; // reading beyond the end of file
+                    return ioError(fileID, pageIDs[i], write);
+                }
+            }
+        }
         int file = fileList[fileID];
-        off_t offset = pageID;
-        offset <<= PAGE_IDX;
-        assert(lseek(file, offset, SEEK_SET) == offset);
-        assert(write(file, (void *) buf, PAGE_SIZE) == PAGE_SIZE);
+        struct iovec iov[IO_VEC_MAX];
+        for (int i = 0, j; i < count; i = j) {
+            if (slots[i].sectors == 0) {
+                memset(bufs[i], 0, PAGE_SIZE);
+                j = i + 1;
+                continue;
+            }
+            for (j = i; j < count && j - i < IO_VEC_MAX && slots[j].sectors &&
+                        (j == i || slots[j].sector == slots[j - 1].sector + slots[j - 1].sectors); j++) {
+                iov[j - i].iov_base = &packed[(size_t) j * PAGE_SIZE];
+                iov[j - i].iov_len = (size_t) slots[j].sectors * COMPRESS_SECTOR;
+            }
+            off_t offset = slots[i].sector;
+            offset *= COMPRESS_SECTOR;
+            if (transfer(file, iov, j - i, offset, write) != 0) {
+                if (write) {
+                    std::lock_guard<std::mutex> lock(map.latch);
+                    map.abandon(slots.data(), count);
+                }
+                return ioError(fileID, pageIDs[i], write);
+            }
+        }
+        if (write) {
+            std::lock_guard<std::mutex> lock(map.latch);
+            map.commit(slots.data(), count);
+            // bound the sectors kept for a crash when nothing syncs
+            if (map.unflushed() >= PAGE_MAP_SYNC_PAGES) return syncLocked(fileID);
+            return 0;
+        }
+        for (int i = 0; i < count; i++) {
+            const char *data = &packed[(size_t) i * PAGE_SIZE];
+            if (slots[i].sectors == 0) continue;
+            if (slots[i].bytes == PAGE_SIZE) {
+                memcpy(bufs[i], data, PAGE_SIZE);
+            } else if (Lz4::decompress(data, slots[i].bytes, bufs[i], PAGE_SIZE) != PAGE_SIZE) {
+                // fails its checksum, like any other corrupted page
+                memset(bufs[i], 0xFF, PAGE_SIZE);
+            }
+        }
+        return 0;
     }
 
-    void readPage(int fileID, int pageID, char *buf) {
+    // sync the data of the compressed file, then its page map, with the
+    // latch of the map held
+    int syncLocked(int fileID) {
+        PageMap &map = *pageMap[fileID];
+        if (map.unflushed() == 0) return 0;
+        if (fdatasync(fileList[fileID]) != 0 || !map.flush()) {
+            fprintf(stderr, "IO Error: syncing file %d: %s\n", fileID, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    // coalesce the runs of consecutive pages into one preadv/pwritev each
+    int transferPages(int fileID, int count, const int *pageIDs, char *const *bufs, bool write) {
         assert(0 <= fileID && fileID < MAX_FILE_NUM && isOpen[fileID]);
+        if (pageMap[fileID]) {
+            return transferCompressed(fileID, count, pageIDs, bufs, write);
+        }
+        if (isDirect[fileID]) {
+            for (int i = 0; i < count; i++) {
+                if ((uintptr_t) bufs[i] % DIRECT_IO_ALIGN != 0) {
+                    return transferBounced(fileID, count, pageIDs, bufs, write);
+                }
+            }
+        }
+#ifdef USE_IO_URING
+        if (useRing) {
+            return transferRing(fileID, count, pageIDs, bufs, write);
+        }
+#endif
         int file = fileList[fileID];
-        off_t offset = pageID;
-        offset <<= PAGE_IDX;
-        assert(lseek(file, offset, SEEK_SET) == offset);
-        assert(read(file, (void *) buf, PAGE_SIZE) == PAGE_SIZE);
+        struct iovec iov[IO_VEC_MAX];
+        for (int i = 0, j; i < count; i = j) {
+            for (j = i; j < count && j - i < IO_VEC_MAX && pageIDs[j] == pageIDs[i] + (j - i); j++) {
+                iov[j - i].iov_base = bufs[j];
+                iov[j - i].iov_len = PAGE_SIZE;
+            }
+            off_t offset = pageIDs[i];
+            offset <<= PAGE_IDX;
+            if (transfer(file, iov, j - i, offset, write) != 0) {
+                return ioError(fileID, pageIDs[i], write);
+            }
+        }
+        return 0;
+    }
+
+public:
+    // name of the page I/O backend in use
+    const char *backend() const {
+#ifdef USE_IO_URING
+        if (useRing) return "io_uring";
+#endif
+        return "posix";
+    }
+
+    // return 0 on success, -1 on error
+    int writePage(int fileID, int pageID, char *buf) {
+        return transferPages(fileID, 1, &pageID, &buf, true);
+    }
+
+    int readPage(int fileID, int pageID, char *buf) {
+        return transferPages(fileID, 1, &pageID, &buf, false);
+    }
+
+    // pageIDs[i] goes to bufs[i], sort pageIDs to have fewer system calls
+    int writePages(int fileID, int count, const int *pageIDs, char *const *bufs) {
+        return transferPages(fileID, count, pageIDs, bufs, true);
+    }
+
+    int readPages(int fileID, int count, const int *pageIDs, char *const *bufs) {
+        return transferPages(fileID, count, pageIDs, bufs, false);
+    }
+
+    // Open the files after this with O_DIRECT, bypassing the page cache.
+    // Buffers not aligned to DIRECT_IO_ALIGN still work, through a copy.
+    // Files on a file system without O_DIRECT are opened as usual.
+    void setDirectIO(bool direct) {
+        directIO = direct;
+    }
+
+    bool isDirectIO(int fileID) {
+        assert(isOpen[fileID]);
+        return isDirect[fileID];
+    }
+
+    bool isCompressed(int fileID) {
+        assert(isOpen[fileID]);
+        return pageMap[fileID] != nullptr;
+    }
+
+    // bytes the pages of a compressed file take compressed, and the size
+    // of the file holding them
+    void getCompressedSize(int fileID, long long &stored, long long &onDisk) {
+        assert(isOpen[fileID] && pageMap[fileID]);
+        std::lock_guard<std::mutex> lock(pageMap[fileID]->latch);
+        stored = pageMap[fileID]->storedBytes();
+        onDisk = pageMap[fileID]->fileBytes();
+    }
+
+    // number of whole pages on the disk
+    int getPageCount(int fileID) {
+        assert(0 <= fileID && fileID < MAX_FILE_NUM && isOpen[fileID]);
+        if (pageMap[fileID]) {
+            std::lock_guard<std::mutex> lock(pageMap[fileID]->latch);
+            return pageMap[fileID]->pageCount();
+        }
+        struct stat st;
+        if (fstat(fileList[fileID], &st) != 0) {
+            return 0;
+        }
+        return (int) (st.st_size >> PAGE_IDX);
+    }
+
+    // cut the file after its first `pageCount` pages
+    int truncateFile(int fileID, int pageCount) {
+        assert(0 <= fileID && fileID < MAX_FILE_NUM && isOpen[fileID]);
+        off_t size = (off_t) pageCount << PAGE_IDX;
+        if (pageMap[fileID]) {
+            std::lock_guard<std::mutex> lock(pageMap[fileID]->latch);
+            pageMap[fileID]->truncate(pageCount);
+            if (syncLocked(fileID) != 0) {
+                return -1;
+            }
+            size = (off_t) pageMap[fileID]->fileBytes();
+        }
+        if (ftruncate(fileList[fileID], size) != 0) {
+            return ioError(fileID, pageCount, true);
+        }
+        return 0;
+    }
+
+    // Map the whole file read-only, return nullptr if it is empty, is
+    // compressed or the mapping fails. Nothing may write the file while it
+    // is mapped.
+    char *mapFile(int fileID, size_t &size) {
+        assert(0 <= fileID && fileID < MAX_FILE_NUM && isOpen[fileID]);
+        if (pageMap[fileID]) {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fileList[fileID], &st) != 0 || st.st_size == 0) {
+            return nullptr;
+        }
+        size = (size_t) st.st_size;
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileList[fileID], 0);
+        if (addr == MAP_FAILED) {
+            return nullptr;
+        }
+        return (char *) addr;
+    }
+
+    static void unmapFile(char *addr, size_t size) {
+        munmap(addr, size);
     }
 
-    void createFile(const char *name) {
-        FILE *file = fopen(name, "a+");
+    // The pages of a compressed file are compressed on the way to the disk
+    // and decompressed on the way back, and are found through its page map.
+    void createFile(const char *name, bool compressed = false) {
+        FILE *file = fopen(name, compressed ? "w" : "a+");
         assert(file);
         fclose(file);
+        if (compressed) {
+            bool created = PageMap::create(std::string(name) + PAGE_MAP_SUFFIX);
+            assert(created);
+            (void) created;
+        }
         permID[name] = nextID++;
     }
 
+    // remove the file and its page map, if any
+    static void removeFile(const char *name) {
+        remove(name);
+        remove((std::string(name) + PAGE_MAP_SUFFIX).c_str());
+    }
+
+    // The pages written to compressed files are read from their new sectors
+    // at once, but the page maps on the disk point to them, and the sectors
+    // they replaced are reused, only after this. Called by the buffer after
+    // each round of write-back and at a checkpoint, so that the data and the
+    // map are synced once for many pages. Return -1 on an I/O error.
+    int syncCompressed() {
+        std::lock_guard<std::mutex> guard(mapLatch);
+        int ret = 0;
+        for (int i = 0; i < MAX_FILE_NUM; i++) {
+            if (!pageMap[i]) continue;
+            std::lock_guard<std::mutex> lock(pageMap[i]->latch);
+            if (syncLocked(i) != 0) ret = -1;
+        }
+        return ret;
+    }
+
     void closeFile(int fileID) {
         assert(isOpen[fileID]);
         isOpen[fileID] = 0;
+        if (pageMap[fileID]) {
+            std::lock_guard<std::mutex> guard(mapLatch);
+            {
+                std::lock_guard<std::mutex> lock(pageMap[fileID]->latch);
+                syncLocked(fileID);
+            }
+            delete pageMap[fileID];
+            pageMap[fileID] = nullptr;
+        }
         int file = fileList[fileID];
         perm2temp.erase(filePermID[fileID]);
         ::close(file);
@@ -96,9 +475,32 @@ public:
         isOpen[fileID] = 1;
         filePermID[fileID] = permID[name];
         perm2temp[filePermID[fileID]] = fileID;
-        int file = open(name, O_RDWR);
+        int file = -1;
+        isDirect[fileID] = false;
+        std::string mapName = std::string(name) + PAGE_MAP_SUFFIX;
+        PageMap *map = nullptr;
+        if (PageMap::exists(mapName)) {
+            map = new PageMap();
+            bool opened = map->open(mapName);
+            assert(opened);
+            (void) opened;
+        }
+#ifdef O_DIRECT
+        // the sectors of a compressed file are not aligned for O_DIRECT
+        if (directIO && !map) {
+            file = open(name, O_RDWR | O_DIRECT);
+            isDirect[fileID] = file != -1;
+        }
+#endif
+        if (file == -1) {
+            file = open(name, O_RDWR);
+        }
         assert(file != -1);
         fileList[fileID] = file;
+        if (map) {
+            std::lock_guard<std::mutex> guard(mapLatch);
+            pageMap[fileID] = map;
+        }
         return fileID;
     }
 
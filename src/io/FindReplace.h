@@ -3,14 +3,16 @@
 
 #include "../util/MultiList.h"
 #include "../constants.h"
+#include "ReplacePolicy.h"
 
-class FindReplace {
+// plain LRU: the first element of the list is the least recently used
+class FindReplace : public ReplacePolicy {
 private:
     MultiList *list;
 public:
-    FindReplace() {
-        list = new MultiList(BUF_CAPACITY, 1);
-        for (int i = 0; i < BUF_CAPACITY; i++) {
+    FindReplace(int c) : ReplacePolicy(c) {
+        list = new MultiList(c, 1);
+        for (int i = 0; i < c; i++) {
             list->insert(0, i);
         }
     }
@@ -19,21 +21,41 @@ public:
         delete list;
     }
 
-    void free(int index) {
+    void free(int index) override {
+        list->insertFirst(0, index);
+    }
+
+    void access(int index) override {
         list->insert(0, index);
     }
 
-    void access(int index) {
+    void load(int index, long long key) override {
+        UNUSED(key);
         list->insert(0, index);
     }
 
-    int find() {
+    int find() override {
         int index = list->getFirst(0);
+        while (!list->isHead(index) && pinned[index]) {
+            index = list->next(index);
+        }
+        if (list->isHead(index)) {
+            return -1;
+        }
         list->erase(index);
         list->insert(0, index);
         return index;
     }
 
+    void tail(int n, std::vector<int> &out) override {
+        for (int index = list->getFirst(0); n > 0 && !list->isHead(index); index = list->next(index)) {
+            if (!pinned[index]) {
+                out.push_back(index);
+                n--;
+            }
+        }
+    }
+
 };
 
 #endif
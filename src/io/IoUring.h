@@ -0,0 +1,203 @@
+#ifndef __IO_URING_H__
+#define __IO_URING_H__
+
+#ifdef USE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// One run of consecutive pages, `result` is the number of bytes transferred
+// or -errno.
+struct IoRun {
+    struct iovec *iov;
+    int cnt;
+    off_t offset;
+    ssize_t result;
+};
+
+// A minimal io_uring on top of the raw system calls, shared by every thread
+// doing page I/O. A caller submits all its runs at once and waits for them,
+// so the runs overlap in the device. One waiting thread at a time blocks in
+// io_uring_enter and hands the completions of the others over to them.
+class IoUring {
+    int ringFd;
+    unsigned sqEntries, cqEntries;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    std::mutex latch;
+    std::condition_variable completed;
+    bool reaping;
+    unsigned inflight;
+
+    struct Batch {
+        int pending;
+    };
+
+    struct Request {
+        IoRun *run;
+        Batch *batch;
+    };
+
+    static int enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    void drainLocked() {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail) return;
+        for (; head != tail; head++) {
+            struct io_uring_cqe &cqe = cqes[head & *cqMask];
+            auto *req = (Request *) (uintptr_t) cqe.user_data;
+            req->run->result = cqe.res;
+            req->batch->pending--;
+            inflight--;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        completed.notify_all();
+    }
+
+    // wait until `done` holds, taking the turn to block in the kernel if
+    // nobody else does
+    template<typename Pred>
+    void waitLocked(std::unique_lock<std::mutex> &lock, Pred done) {
+        drainLocked();
+        while (!done()) {
+            if (reaping) {
+                completed.wait(lock);
+                continue;
+            }
+            reaping = true;
+            lock.unlock();
+            int ret = enter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+            lock.lock();
+            reaping = false;
+            if (ret < 0 && errno != EINTR) {
+                // nothing we can do, the requests stay pending forever otherwise
+                perror("io_uring_enter");
+                abort();
+            }
+            drainLocked();
+            completed.notify_all();
+        }
+    }
+
+public:
+    IoUring() : ringFd(-1), sqes((struct io_uring_sqe *) MAP_FAILED), sqRing(MAP_FAILED), cqRing(MAP_FAILED),
+                reaping(false), inflight(0) {}
+
+    ~IoUring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (ringFd != -1) ::close(ringFd);
+    }
+
+    // return false if io_uring is not available, e.g. an old kernel or seccomp
+    bool init(unsigned entries) {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        ringFd = (int) syscall(__NR_io_uring_setup, entries, &p);
+        if (ringFd < 0) {
+            ringFd = -1;
+            return false;
+        }
+        sqEntries = p.sq_entries;
+        cqEntries = p.cq_entries;
+        sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                          IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) return false;
+        }
+        sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe *) mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        char *sq = (char *) sqRing, *cq = (char *) cqRing;
+        sqHead = (unsigned *) (sq + p.sq_off.head);
+        sqTail = (unsigned *) (sq + p.sq_off.tail);
+        sqMask = (unsigned *) (sq + p.sq_off.ring_mask);
+        sqArray = (unsigned *) (sq + p.sq_off.array);
+        cqHead = (unsigned *) (cq + p.cq_off.head);
+        cqTail = (unsigned *) (cq + p.cq_off.tail);
+        cqMask = (unsigned *) (cq + p.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+        return true;
+    }
+
+    // submit all the runs on `file` and wait for them to complete
+    void transfer(int file, IoRun *runs, int n, bool write) {
+        Batch batch;
+        batch.pending = n;
+        std::vector<Request> reqs(n);
+        std::unique_lock<std::mutex> lock(latch);
+        for (int i = 0; i < n;) {
+            // the completion queue must never overflow
+            waitLocked(lock, [this] { return inflight < cqEntries; });
+            unsigned tail = *sqTail;
+            unsigned room = sqEntries - (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE));
+            unsigned count = 0;
+            for (; i < n && count < room && inflight < cqEntries; i++, count++, inflight++) {
+                unsigned idx = (tail + count) & *sqMask;
+                struct io_uring_sqe &sqe = sqes[idx];
+                memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+                sqe.fd = file;
+                sqe.off = (unsigned long long) runs[i].offset;
+                sqe.addr = (unsigned long long) (uintptr_t) runs[i].iov;
+                sqe.len = (unsigned) runs[i].cnt;
+                reqs[i].run = runs + i;
+                reqs[i].batch = &batch;
+                sqe.user_data = (unsigned long long) (uintptr_t) &reqs[i];
+                sqArray[idx] = idx;
+            }
+            __atomic_store_n(sqTail, tail + count, __ATOMIC_RELEASE);
+            while (count > 0) {
+                int ret = enter(ringFd, count, 0, 0);
+                if (ret < 0) {
+                    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                        lock.unlock();
+                        sched_yield();
+                        lock.lock();
+                        continue;
+                    }
+                    perror("io_uring_enter");
+                    abort();
+                }
+                count -= ret;
+            }
+        }
+        waitLocked(lock, [&batch] { return batch.pending == 0; });
+    }
+};
+
+#endif
+
+#endif
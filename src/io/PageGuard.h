@@ -0,0 +1,76 @@
+#ifndef __PAGE_GUARD_H__
+#define __PAGE_GUARD_H__
+
+#include "BufPageManager.h"
+
+// Keeps a page pinned in the buffer while the guard is alive, so the pointer
+// returned by data() stays valid across other page fetches.
+class PageGuard {
+    int index;
+    char *page;
+
+public:
+    PageGuard() : index(-1), page(nullptr) {}
+
+    PageGuard(int fileID, int pageID) {
+        index = BufPageManager::getInstance().pinPage(fileID, pageID);
+        page = BufPageManager::getInstance().access(index);
+    }
+
+    // take over a frame pinned by BufPageManager::pinPage or allocPage
+    explicit PageGuard(int index) : index(index) {
+        page = BufPageManager::getInstance().access(index);
+    }
+
+    // a new page of the file, not read from it
+    static PageGuard alloc(int fileID, int pageID) {
+        return PageGuard(BufPageManager::getInstance().allocPage(fileID, pageID, false, true));
+    }
+
+    PageGuard(PageGuard &&other) : index(other.index), page(other.page) {
+        other.index = -1;
+        other.page = nullptr;
+    }
+
+    PageGuard &operator=(PageGuard &&other) {
+        if (this != &other) {
+            reset();
+            index = other.index;
+            page = other.page;
+            other.index = -1;
+            other.page = nullptr;
+        }
+        return *this;
+    }
+
+    PageGuard(const PageGuard &) = delete;
+
+    PageGuard &operator=(const PageGuard &) = delete;
+
+    ~PageGuard() {
+        reset();
+    }
+
+    char *data() const {
+        return page;
+    }
+
+    int getIndex() const {
+        return index;
+    }
+
+    void markDirty() {
+        assert(index != -1);
+        BufPageManager::getInstance().markDirty(index);
+    }
+
+    void reset() {
+        if (index != -1) {
+            BufPageManager::getInstance().unpin(index);
+            index = -1;
+            page = nullptr;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef __PAGE_MAP_H__
+#define __PAGE_MAP_H__
+
+#include "../constants.h"
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+// space of a compressed file is counted in sectors
+#define COMPRESS_SECTOR 512
+#define PAGE_SECTORS (PAGE_SIZE / COMPRESS_SECTOR)
+// the page map of a compressed file `name` is kept in `name` PAGE_MAP_SUFFIX
+#define PAGE_MAP_SUFFIX ".pmap"
+// pages written to a compressed file between two syncs at most
+#define PAGE_MAP_SYNC_PAGES 1024
+
+// Where the pages of a compressed file are. A page takes a run of whole
+// sectors, and every write of it goes to the smallest free run that fits or
+// to the end of the file. The new slots are appended to the map file once
+// the data has been synced, a batch of writes at a time, and only then are
+// the old sectors freed, so after a crash the map points to either version
+// of each page. Free runs next to each other are merged. The map file is
+// replayed when the file is opened and compacted when it is closed. In the
+// map file, a slot without sectors drops the pages from its pageID on.
+class PageMap {
+public:
+    struct Slot {
+        int32_t pageID;
+        uint32_t sector;
+        uint16_t sectors; // 0 if the page was never written
+        uint16_t bytes;   // PAGE_SIZE if the page is not compressed
+    };
+
+    // serializes the users of the map, not the reads of the pages
+    std::mutex latch;
+
+private:
+    std::string name;
+    std::vector<Slot> slots;
+    // the free runs before endSector, by sector and by size
+    std::map<uint32_t, uint32_t> holes;
+    std::set<std::pair<uint32_t, uint32_t>> holeSizes;
+    // slots not in the map file yet, and the runs they replaced
+    std::vector<Slot> changes;
+    std::vector<std::pair<uint32_t, uint32_t>> replaced;
+    uint32_t endSector;
+    long long logged;
+    FILE *log;
+
+    void addHole(uint32_t sector, uint32_t count) {
+        holes[sector] = count;
+        holeSizes.insert(std::make_pair(count, sector));
+    }
+
+    void eraseHole(std::map<uint32_t, uint32_t>::iterator it) {
+        holeSizes.erase(std::make_pair(it->second, it->first));
+        holes.erase(it);
+    }
+
+    // give back a run, merged with the free runs around it
+    void release(uint32_t sector, uint32_t count) {
+        auto next = holes.lower_bound(sector);
+        if (next != holes.end() && sector + count == next->first) {
+            count += next->second;
+            eraseHole(next++);
+        }
+        if (next != holes.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == sector) {
+                sector = prev->first;
+                count += prev->second;
+                eraseHole(prev);
+            }
+        }
+        if (sector + count == endSector) {
+            endSector = sector;
+        } else {
+            addHole(sector, count);
+        }
+    }
+
+    // the free runs are what the slots do not cover
+    void findHoles() {
+        holes.clear();
+        holeSizes.clear();
+        std::vector<Slot> used;
+        for (auto &s : slots) {
+            if (s.sectors) used.push_back(s);
+        }
+        std::sort(used.begin(), used.end(), [](const Slot &a, const Slot &b) {
+            return a.sector < b.sector;
+        });
+        uint32_t next = 0;
+        for (auto &s : used) {
+            if (s.sector > next) addHole(next, s.sector - next);
+            next = std::max(next, s.sector + s.sectors);
+        }
+        endSector = next;
+    }
+
+    uint32_t allocate(uint32_t need) {
+        auto best = holeSizes.lower_bound(std::make_pair(need, (uint32_t) 0));
+        if (best == holeSizes.end()) {
+            uint32_t sector = endSector;
+            endSector += need;
+            return sector;
+        }
+        uint32_t count = best->first, sector = best->second;
+        eraseHole(holes.find(sector));
+        if (count > need) addHole(sector + need, count - need);
+        return sector;
+    }
+
+    bool rewrite() {
+        std::string tmp = name + ".tmp";
+        FILE *file = fopen(tmp.c_str(), "wb");
+        if (!file) return false;
+        bool ok = true;
+        for (auto &s : slots) {
+            if (s.sectors) ok = ok && fwrite(&s, sizeof(Slot), 1, file) == 1;
+        }
+        ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+        ok = fclose(file) == 0 && ok;
+        ok = ok && rename(tmp.c_str(), name.c_str()) == 0;
+        if (!ok) {
+            remove(tmp.c_str());
+            return false;
+        }
+        logged = 0;
+        for (auto &s : slots) logged += s.sectors != 0;
+        return true;
+    }
+
+public:
+    PageMap() : endSector(0), logged(0), log(nullptr) {}
+
+    ~PageMap() {
+        close();
+    }
+
+    static bool create(const std::string &name) {
+        FILE *file = fopen(name.c_str(), "wb");
+        if (!file) return false;
+        fclose(file);
+        return true;
+    }
+
+    static bool exists(const std::string &name) {
+        FILE *file = fopen(name.c_str(), "rb");
+        if (!file) return false;
+        fclose(file);
+        return true;
+    }
+
+    bool open(const std::string &name) {
+        this->name = name;
+        FILE *file = fopen(name.c_str(), "rb");
+        if (!file) return false;
+        Slot s;
+        logged = 0;
+        while (fread(&s, sizeof(Slot), 1, file) == 1) {
+            if (s.pageID < 0 || s.sectors > PAGE_SECTORS) continue;
+            if (s.sectors == 0) {
+                if (s.pageID < (int) slots.size()) slots.resize((size_t) s.pageID);
+                logged++;
+                continue;
+            }
+            if ((int) slots.size() <= s.pageID) slots.resize((size_t) s.pageID + 1, Slot{0, 0, 0, 0});
+            slots[s.pageID] = s;
+            logged++;
+        }
+        fclose(file);
+        findHoles();
+        // a long log is mostly pages moved long ago
+        if (logged > 2 * (long long) slots.size() + 64) rewrite();
+        log = fopen(name.c_str(), "ab");
+        return log != nullptr;
+    }
+
+    // the data of the pages written must be synced before
+    void close() {
+        if (!log) return;
+        flush();
+        fclose(log);
+        log = nullptr;
+        rewrite();
+    }
+
+    // pages up to the last one written
+    int pageCount() const {
+        return (int) slots.size();
+    }
+
+    // nullptr if the page was never written
+    const Slot *find(int pageID) const {
+        if (pageID < 0 || pageID >= (int) slots.size() || slots[pageID].sectors == 0) {
+            return nullptr;
+        }
+        return &slots[pageID];
+    }
+
+    // new sectors for `bytes` bytes of the page, the page stays where it is
+    // until the slot is committed
+    Slot place(int pageID, int bytes) {
+        assert(0 < bytes && bytes <= PAGE_SIZE);
+        uint32_t need = (uint32_t) (bytes + COMPRESS_SECTOR - 1) / COMPRESS_SECTOR;
+        return Slot{pageID, allocate(need), (uint16_t) need, (uint16_t) bytes};
+    }
+
+    // The pages are read from the placed slots, whose data has been written,
+    // from now on. Their old sectors stay taken until the next flush.
+    void commit(const Slot *placed, int count) {
+        for (int i = 0; i < count; i++) {
+            const Slot &p = placed[i];
+            if ((int) slots.size() <= p.pageID) slots.resize((size_t) p.pageID + 1, Slot{0, 0, 0, 0});
+            Slot &s = slots[p.pageID];
+            if (s.sectors) replaced.push_back(std::make_pair(s.sector, (uint32_t) s.sectors));
+            s = p;
+            changes.push_back(p);
+        }
+    }
+
+    // free the sectors of placed slots that will not be committed
+    void abandon(const Slot *placed, int count) {
+        for (int i = 0; i < count; i++) release(placed[i].sector, placed[i].sectors);
+    }
+
+    // drop the pages from `pageCount` on, the file may be cut at fileBytes
+    // after the next flush
+    void truncate(int pageCount) {
+        if (pageCount >= (int) slots.size()) return;
+        for (size_t i = (size_t) pageCount; i < slots.size(); i++) {
+            if (slots[i].sectors) replaced.push_back(std::make_pair(slots[i].sector, (uint32_t) slots[i].sectors));
+        }
+        slots.resize((size_t) pageCount);
+        changes.push_back(Slot{pageCount, 0, 0, 0});
+    }
+
+    // slots committed since the last flush
+    int unflushed() const {
+        return (int) changes.size();
+    }
+
+    // Append the changes since the last flush to the map file and sync it,
+    // then free the sectors they replaced. The data of the pages must have
+    // been synced before.
+    bool flush() {
+        if (changes.empty()) return true;
+        bool ok = log && fwrite(changes.data(), sizeof(Slot), changes.size(), log) == changes.size();
+        ok = ok && fflush(log) == 0 && fsync(fileno(log)) == 0;
+        if (!ok) return false;
+        logged += (long long) changes.size();
+        changes.clear();
+        for (auto &r : replaced) release(r.first, r.second);
+        replaced.clear();
+        return true;
+    }
+
+    // bytes of the pages as stored, without the rest of their sectors
+    long long storedBytes() const {
+        long long total = 0;
+        for (auto &s : slots) {
+            if (s.sectors) total += s.bytes;
+        }
+        return total;
+    }
+
+    long long fileBytes() const {
+        return (long long) endSector * COMPRESS_SECTOR;
+    }
+};
+
+#endif
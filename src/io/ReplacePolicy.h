@@ -0,0 +1,56 @@
+#ifndef __REPLACE_POLICY_H__
+#define __REPLACE_POLICY_H__
+
+#include <vector>
+
+enum ReplacePolicyType {
+    RP_LRU, RP_2Q, RP_CLOCK_PRO
+};
+
+// Interface of the frame replacement policies used by BufPageManager.
+// Frames are identified by their index in the buffer, pages by a key
+// combining fileID and pageID, see pageKey().
+// find() never returns a pinned frame, and returns -1 if every frame is pinned.
+class ReplacePolicy {
+protected:
+    std::vector<bool> pinned;
+    int pinnedCount;
+
+public:
+    ReplacePolicy(int c) : pinned(c), pinnedCount(0) {}
+
+    virtual ~ReplacePolicy() = default;
+
+    void setEvictable(int index, bool evictable) {
+        if (pinned[index] == evictable) {
+            pinned[index] = !evictable;
+            pinnedCount += evictable ? -1 : 1;
+        }
+    }
+
+    int getPinnedCount() const {
+        return pinnedCount;
+    }
+
+    // frame `index` is empty now and should be reused first
+    virtual void free(int index) = 0;
+
+    // frame `index` is hit
+    virtual void access(int index) = 0;
+
+    // frame `index` (returned by find) has been loaded with page `key`
+    virtual void load(int index, long long key) = 0;
+
+    // choose a frame to be replaced
+    virtual int find() = 0;
+
+    // append up to n unpinned frames that are likely to be replaced next,
+    // the ones to go first come first
+    virtual void tail(int n, std::vector<int> &out) = 0;
+
+    static long long pageKey(int fileID, int pageID) {
+        return ((long long) fileID << 32) | (unsigned int) pageID;
+    }
+};
+
+#endif
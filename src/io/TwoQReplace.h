@@ -0,0 +1,159 @@
+#ifndef __TWO_Q_REPLACE_H__
+#define __TWO_Q_REPLACE_H__
+
+#include <deque>
+#include <utility>
+#include <unordered_map>
+#include "../util/MultiList.h"
+#include "ReplacePolicy.h"
+
+// Full 2Q (Johnson & Shasha, VLDB'94).
+// Pages seen once live in the FIFO queue A1in, pages referenced again while
+// their key is remembered in the ghost queue A1out are promoted to the LRU
+// queue Am. A sequential scan only cycles through A1in and never touches Am.
+class TwoQReplace : public ReplacePolicy {
+private:
+    enum {
+        LIST_FREE, LIST_A1IN, LIST_AM
+    };
+    int cap;
+    int kin, kout;
+    int a1inSize;
+    MultiList *list;
+    int *where;
+    long long *keys;
+    // A1out, a FIFO of keys of pages recently evicted from A1in.
+    // Entries in `ghostQueue` are stale if their sequence number does not
+    // match the one in `ghost`.
+    std::deque<std::pair<long long, long long>> ghostQueue;
+    std::unordered_map<long long, long long> ghost;
+    long long ghostSeq;
+
+    void remember(long long key) {
+        ghost[key] = ++ghostSeq;
+        ghostQueue.push_back(std::make_pair(key, ghostSeq));
+        while ((int) ghost.size() > kout || ghostQueue.size() > 2 * (size_t) kout) {
+            auto front = ghostQueue.front();
+            ghostQueue.pop_front();
+            auto it = ghost.find(front.first);
+            if (it != ghost.end() && it->second == front.second) {
+                ghost.erase(it);
+            }
+        }
+    }
+
+    void detach(int index) {
+        if (where[index] == LIST_A1IN) {
+            a1inSize--;
+        }
+        where[index] = -1;
+        list->erase(index);
+    }
+
+    int firstUnpinned(int listID) {
+        int index = list->getFirst(listID);
+        while (!list->isHead(index) && pinned[index]) {
+            index = list->next(index);
+        }
+        return list->isHead(index) ? -1 : index;
+    }
+
+public:
+    TwoQReplace(int c) : ReplacePolicy(c) {
+        cap = c;
+        kin = cap / 4 > 0 ? cap / 4 : 1;
+        kout = cap / 2 > 0 ? cap / 2 : 1;
+        a1inSize = 0;
+        ghostSeq = 0;
+        list = new MultiList(cap, 3);
+        where = new int[cap];
+        keys = new long long[cap];
+        for (int i = 0; i < cap; i++) {
+            list->insert(LIST_FREE, i);
+            where[i] = LIST_FREE;
+            keys[i] = -1;
+        }
+    }
+
+    ~TwoQReplace() {
+        delete list;
+        delete[] where;
+        delete[] keys;
+    }
+
+    void free(int index) override {
+        detach(index);
+        list->insertFirst(LIST_FREE, index);
+        where[index] = LIST_FREE;
+        keys[index] = -1;
+    }
+
+    void access(int index) override {
+        // a hit in A1in is regarded as correlated, only Am is reordered
+        if (where[index] == LIST_AM) {
+            list->insert(LIST_AM, index);
+        }
+    }
+
+    void load(int index, long long key) override {
+        detach(index);
+        keys[index] = key;
+        auto it = ghost.find(key);
+        if (it != ghost.end()) {
+            ghost.erase(it);
+            list->insert(LIST_AM, index);
+            where[index] = LIST_AM;
+        } else {
+            list->insert(LIST_A1IN, index);
+            where[index] = LIST_A1IN;
+            a1inSize++;
+        }
+    }
+
+    int find() override {
+        int index;
+        if (!list->isHead(index = list->getFirst(LIST_FREE))) {
+            detach(index);
+            return index;
+        }
+        int first = LIST_AM, second = LIST_A1IN;
+        if (a1inSize > kin) {
+            std::swap(first, second);
+        }
+        if ((index = firstUnpinned(first)) == -1 && (index = firstUnpinned(second)) == -1) {
+            return -1;
+        }
+        if (where[index] == LIST_A1IN) {
+            remember(keys[index]);
+        }
+        detach(index);
+        return index;
+    }
+
+    // A1in is drained down to kin first, then Am goes
+    void tail(int n, std::vector<int> &out) override {
+        int fromA1in = a1inSize - kin;
+        int index = list->getFirst(LIST_A1IN);
+        for (; fromA1in > 0 && n > 0 && !list->isHead(index); index = list->next(index), fromA1in--) {
+            if (!pinned[index]) {
+                out.push_back(index);
+                n--;
+            }
+        }
+        for (int i = list->getFirst(LIST_AM); n > 0 && !list->isHead(i); i = list->next(i)) {
+            if (!pinned[i]) {
+                out.push_back(i);
+                n--;
+            }
+        }
+        for (; n > 0 && !list->isHead(index); index = list->next(index)) {
+            if (!pinned[index]) {
+                out.push_back(index);
+                n--;
+            }
+        }
+    }
+
+};
+
+#endif
@@ -1,5 +1,9 @@
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
 #include "dbms/DBMS.h"
+#include "io/BufPageManager.h"
 
 #ifdef __cplusplus
 extern "C" char start_parse(const char *expr_input);
@@ -7,14 +11,115 @@ extern "C" char start_parse(const char *expr_input);
 
 bool initMode = false;
 
+// options in the form of --name=value, return false if unknown
+bool parseOption(const char *option) {
+    const char *value = strchr(option, '=');
+    if (value == nullptr) {
+        return false;
+    }
+    std::string name(option + 2, value++);
+    if (name == "buffer-policy") {
+        if (strcmp(value, "lru") == 0) {
+            BufPageManager::setReplacePolicy(RP_LRU);
+        } else if (strcmp(value, "2q") == 0) {
+            BufPageManager::setReplacePolicy(RP_2Q);
+        } else if (strcmp(value, "clock-pro") == 0) {
+            BufPageManager::setReplacePolicy(RP_CLOCK_PRO);
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (name == "buffer-size") {
+        char *end;
+        long size = strtol(value, &end, 10);
+        if (*end != '\0' || size <= 0 || size > INT_MAX / 2) {
+            return false;
+        }
+        BufPageManager::setCapacity((int) size);
+        return true;
+    }
+    if (name == "flush-fraction") {
+        char *end;
+        double fraction = strtod(value, &end);
+        if (*end != '\0' || fraction < 0 || fraction > 1) {
+            return false;
+        }
+        BufPageManager::setFlushFraction(fraction);
+        return true;
+    }
+    if (name == "direct-io") {
+        if (strcmp(value, "on") == 0) {
+            BufPageManager::setDirectIO(true);
+        } else if (strcmp(value, "off") == 0) {
+            BufPageManager::setDirectIO(false);
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (name == "buffer-shards") {
+        char *end;
+        long shards = strtol(value, &end, 10);
+        if (*end != '\0' || shards <= 0 || shards > 1024) {
+            return false;
+        }
+        BufPageManager::setShards((int) shards);
+        return true;
+    }
+    if (name == "buffer-warmup") {
+        if (strcmp(value, "on") == 0) {
+            BufPageManager::setWarmUp(true);
+        } else if (strcmp(value, "off") == 0) {
+            BufPageManager::setWarmUp(false);
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (name == "best-effort-reads") {
+        if (strcmp(value, "on") == 0) {
+            BufPageManager::setBestEffortReads(true);
+        } else if (strcmp(value, "off") == 0) {
+            BufPageManager::setBestEffortReads(false);
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (name == "read-ahead") {
+        char *end;
+        long pages = strtol(value, &end, 10);
+        if (*end != '\0' || pages < 0 || pages > IO_VEC_MAX * 16) {
+            return false;
+        }
+        BufPageManager::setReadAhead((int) pages);
+        return true;
+    }
+    return false;
+}
+
 int main(int argc, char const *argv[]) {
+    while (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (!parseOption(argv[1])) {
+            fprintf(stderr, "Invalid option: %s\n", argv[1]);
+            return 1;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
     if (argc < 2) {
         return start_parse(nullptr); //read SQL from STDIN
     } else {
+        bool readOnly = false;
         if (argc == 3 && strcmp("init", argv[2]) == 0) {
             initMode = true;
         }
-        DBMS::getInstance()->switchToDB(argv[1]); //first parameter is Database name
+        if (argc == 3 && strcmp("readonly", argv[2]) == 0) {
+            readOnly = true;
+        }
+        DBMS::getInstance()->switchToDB(argv[1], readOnly); //first parameter is Database name
         return start_parse(nullptr);
     }
 }
@@ -3,6 +3,7 @@
 #include "Execute.h"
 
 #include "dbms/DBMS.h"
+#include "io/BufPageManager.h"
 
 void free_column_ref(column_ref *c) {
     if (c->table)
@@ -61,10 +62,19 @@ void execute_desc_tables(const char *table_name) {
     free((void *) table_name);
 }
 
+void execute_vacuum(const char *table_name) {
+    DBMS::getInstance()->vacuumTable(table_name);
+    free((void *) table_name);
+}
+
 void execute_show_tables() {
     DBMS::getInstance()->listTables();
 }
 
+void execute_show_buffer_status() {
+    DBMS::getInstance()->showBufferStatus();
+}
+
 void execute_create_db(const char *db_name) {
     Database db;
     db.create(db_name);
@@ -73,7 +83,8 @@ void execute_create_db(const char *db_name) {
 }
 
 void execute_create_tb(const table_def *table) {
-    DBMS::getInstance()->createTable(table);
+    if (table->layout != -1)
+        DBMS::getInstance()->createTable(table);
     free((void *) table->name);
     column_defs *c = table->columns;
     while (c) {
@@ -121,6 +132,11 @@ void execute_use_db(const char *db_name) {
     free((void *) db_name);
 }
 
+void execute_use_db_readonly(const char *db_name) {
+    DBMS::getInstance()->switchToDB(db_name, true);
+    free((void *) db_name);
+}
+
 void execute_insert_row(struct insert_argu *stmt) {
     assert(stmt->table);
     DBMS::getInstance()->insertRow(stmt->table, stmt->columns, stmt->values);
@@ -130,7 +146,12 @@ void execute_insert_row(struct insert_argu *stmt) {
 }
 
 void execute_select(struct select_argu *stmt) {
-    DBMS::getInstance()->selectRow(stmt->tables, stmt->column_expr, stmt->where);
+    try {
+        DBMS::getInstance()->selectRow(stmt->tables, stmt->column_expr, stmt->where);
+    } catch (const ChecksumError &e) {
+        // nothing was changed, the next statements can still run
+        report_sql_error("Checksum", e.what());
+    }
     free_tables(stmt->tables);
     free_expr_list(stmt->column_expr);
     if (stmt->where)
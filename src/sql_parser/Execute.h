@@ -10,12 +10,15 @@ extern "C" {
 
 void report_sql_error(const char *error_name, const char *msg);
 void execute_desc_tables(const char *table_name);
+void execute_vacuum(const char *table_name);
 void execute_show_tables();
+void execute_show_buffer_status();
 void execute_create_tb(const table_def *table);
 void execute_create_db(const char *db_name);
 void execute_drop_db(const char *db_name);
 void execute_drop_table(const char *table_name);
 void execute_use_db(const char *db_name);
+void execute_use_db_readonly(const char *db_name);
 void execute_insert_row(struct insert_argu *stmt);
 void execute_sql_eof(void);
 void execute_select(struct select_argu *stmt);
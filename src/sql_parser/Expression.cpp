@@ -392,6 +392,8 @@ bool Expression::operator<(const Expression &b) const {
         case TERM_FLOAT:
             return value.value_f < b.value.value_f;
             break;
+        case TERM_STRING:
+            return strcmp(value.value_s, b.value.value_s) < 0;
         default:
             throw (int) EXCEPTION_ILLEGAL_OP;
     }
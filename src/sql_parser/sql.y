@@ -44,18 +44,18 @@ int yyerror(const char *str);
 %token CREATE SELECT WHERE INSERT INTO FROM
 %token DEFAULT CHECK PRIMARY FOREIGN KEY REFERENCES
 %token GROUP ORDER BY DELETE LIKE SHOW
-%token IDENTIFIER FLOAT DATE EXIT
+%token IDENTIFIER FLOAT DATE EXIT VACUUM
 %token DATE_LITERAL
 %token STRING_LITERAL
 %token FLOAT_LITERAL
 %token INT_LITERAL
 
-%type <val_s> table_name db_name desc_stmt IDENTIFIER STRING_LITERAL DATE_LITERAL
+%type <val_s> table_name db_name desc_stmt vacuum_stmt IDENTIFIER STRING_LITERAL DATE_LITERAL
 %type <val_s> create_db_stmt drop_db_stmt use_db_stmt drop_tb_stmt
 %type <val_s> table_join
 %type <val_f> FLOAT_LITERAL
 %type <ref_column> column_ref
-%type <val_i> show_stmt column_type column_constraints column_constraint type_width
+%type <val_i> show_stmt tb_options tb_option column_type column_constraints column_constraint type_width
 %type <val_i> INT_LITERAL compare_op logic_op
 %type <def_column> column_decs column_dec
 %type <def_table> create_tb_stmt
@@ -89,8 +89,21 @@ sql_stmt: create_db_stmt ';' {execute_create_db($1);}
         | drop_db_stmt ';' {execute_drop_db($1);}
         | drop_tb_stmt ';' {execute_drop_table($1);}
         | use_db_stmt  ';' {execute_use_db($1);}
-        | show_stmt  ';' {if($1==1) execute_show_tables();}
+        | use_db_stmt IDENTIFIER ';' {
+                if(strcasecmp("READONLY", $2)==0)
+                    execute_use_db_readonly($1);
+                else {
+                    report_sql_error("Unknown USE option", $2);
+                    free($1);
+                }
+                free($2);
+            }
+        | show_stmt  ';' {
+                if($1==1) execute_show_tables();
+                else if($1==2) execute_show_buffer_status();
+            }
         | desc_stmt  ';' {execute_desc_tables($1);}
+        | vacuum_stmt ';' {execute_vacuum($1);}
         | EXIT ';' {execute_sql_eof(); exit(0);}
         ;
 
@@ -100,11 +113,23 @@ show_stmt: SHOW IDENTIFIER {
                 else
                     report_sql_error("Unknown SHOW", $2);
             }
+        | SHOW IDENTIFIER IDENTIFIER {
+                $$ = 0;
+                if(strcasecmp("BUFFER", $2)==0 && strcasecmp("STATUS", $3)==0)
+                    $$ = 2;
+                else
+                    report_sql_error("Unknown SHOW", $2);
+                free($2);
+                free($3);
+            }
             ;
 
 desc_stmt: DESC table_name { $$=$2; }
             ;
 
+vacuum_stmt: VACUUM table_name { $$=$2; }
+            ;
+
 create_idx_stmt: CREATE INDEX IDENTIFIER '(' IDENTIFIER ')' {$$=(column_ref*)malloc(sizeof(column_ref));$$->table=$3;$$->column=$5;}
                 ;
 
@@ -121,14 +146,43 @@ use_db_stmt: USE DATABASE db_name {$$=$3;}
             |USE db_name {$$=$2;}
             ;
 
-create_tb_stmt: CREATE TABLE table_name '(' column_decs tb_opt_exist')' {
+create_tb_stmt: CREATE TABLE table_name '(' column_decs tb_opt_exist')' tb_options {
                     $$ = (table_def*)malloc(sizeof(table_def));
                     $$->name = $3;
                     $$->columns = $5;
                     $$->constraints = $6;
+                    $$->layout = $8 == -1 ? -1 : ($8 & ~TABLE_COMPRESSED);
+                    $$->compressed = $8 != -1 && ($8 & TABLE_COMPRESSED);
                 }
                 ;
 
+tb_options: tb_options tb_option {
+                if($1 == -1 || $2 == -1)
+                    $$ = -1;
+                else if($2 == TABLE_COMPRESSED)
+                    $$ = $1 | TABLE_COMPRESSED;
+                else
+                    $$ = ($1 & TABLE_COMPRESSED) | $2;
+            }
+            | {$$ = TABLE_LAYOUT_ROW;}
+            ;
+
+tb_option: IDENTIFIER {
+                $$ = -1;
+                if(strcasecmp("SLOTTED", $1)==0)
+                    $$ = TABLE_LAYOUT_SLOTTED;
+                else if(strcasecmp("PAX", $1)==0)
+                    $$ = TABLE_LAYOUT_PAX;
+                else if(strcasecmp("ROW", $1)==0)
+                    $$ = TABLE_LAYOUT_ROW;
+                else if(strcasecmp("COMPRESSED", $1)==0)
+                    $$ = TABLE_COMPRESSED;
+                else
+                    report_sql_error("Unknown table option", $1);
+                free($1);
+            }
+            ;
+
 drop_tb_stmt: DROP TABLE table_name {$$=$3;}
             ;
 
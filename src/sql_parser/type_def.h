@@ -59,6 +59,15 @@ typedef enum term_type {
     TERM_DATE
 } term_type;
 
+typedef enum table_layout {
+    TABLE_LAYOUT_ROW,
+    TABLE_LAYOUT_SLOTTED,
+    TABLE_LAYOUT_PAX
+} table_layout;
+
+// or-ed with the layout of a table
+#define TABLE_COMPRESSED 0x100
+
 typedef enum constraint_type {
     CONSTRAINT_PRIMARY_KEY,
     CONSTRAINT_FOREIGN_KEY,
@@ -87,6 +96,8 @@ typedef struct table_def {
     char *name;
     column_defs *columns;
     linked_list *constraints;
+    int layout; // -1 if unknown
+    int compressed;
 } table_def;
 
 typedef struct table_constraint {
@@ -0,0 +1,83 @@
+#ifndef __CRC32C_H__
+#define __CRC32C_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_SSE42
+#endif
+
+// CRC32C (Castagnoli), with the crc32 instruction of SSE4.2 when the CPU
+// has it and a table otherwise. Both give the same result.
+class Crc32c {
+    // reversed 0x1EDC6F41
+    static const uint32_t poly = 0x82F63B78u;
+
+    static const uint32_t *table() {
+        static uint32_t t[256];
+        static bool ready = init(t);
+        (void) ready;
+        return t;
+    }
+
+    static bool init(uint32_t *t) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+            }
+            t[i] = c;
+        }
+        return true;
+    }
+
+    static uint32_t software(uint32_t crc, const unsigned char *p, size_t len) {
+        const uint32_t *t = table();
+        while (len--) {
+            crc = t[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#ifdef CRC32C_SSE42
+    __attribute__((target("sse4.2")))
+    static uint32_t hardware(uint32_t crc, const unsigned char *p, size_t len) {
+        uint64_t c = crc;
+        for (; len >= 8; p += 8, len -= 8) {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            c = _mm_crc32_u64(c, word);
+        }
+        crc = (uint32_t) c;
+        for (; len > 0; p++, len--) {
+            crc = _mm_crc32_u8(crc, *p);
+        }
+        return crc;
+    }
+#endif
+
+public:
+    static bool isHardware() {
+#ifdef CRC32C_SSE42
+        static bool has = __builtin_cpu_supports("sse4.2");
+        return has;
+#else
+        return false;
+#endif
+    }
+
+    static uint32_t compute(const void *data, size_t len) {
+        auto p = (const unsigned char *) data;
+#ifdef CRC32C_SSE42
+        if (isHardware()) {
+            return ~hardware(~0u, p, len);
+        }
+#endif
+        return ~software(~0u, p, len);
+    }
+};
+
+#endif
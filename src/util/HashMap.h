@@ -1,68 +1,138 @@
 #ifndef __HASH_MAP_H__
 #define __HASH_MAP_H__
 
-#include "MultiList.h"
+#include <cassert>
+#include <cstdint>
 
+// Maps (key1, key2) to an index in [0, cap), each index holds at most one key.
+// Open addressing with Robin Hood linear probing. The table has at least
+// twice as many slots as indexes, a slot is 16 bytes so that a probe
+// sequence usually stays in one cache line.
 class HashMap {
 private:
-    struct DataNode {
-        int key1, key2;
+    struct Slot {
+        uint64_t key;
+        int index; // -1 if empty
+        int dist;  // distance from the home slot
     };
-    static const int base = 97;
-    static const int mod = 48611; // prime[5000]
     int cap;
-    MultiList *list;
-    DataNode *a;
+    int bits;
+    uint64_t mask;
+    Slot *slots;
+    uint64_t *keys; // key of each index, `emptyKey` if none
 
-    int hash(int k1, int k2) {
-        return (k1 + (long long) k2 * base) % mod;
+    static const uint64_t emptyKey = ~(uint64_t) 0;
+
+    static uint64_t makeKey(int k1, int k2) {
+        return ((uint64_t) (uint32_t) k1 << 32) | (uint32_t) k2;
+    }
+
+    // Fibonacci hashing
+    uint64_t home(uint64_t key) {
+        return (key * 0x9E3779B97F4A7C15ull) >> (64 - bits);
+    }
+
+    // return the slot holding key, -1 if not found
+    int findSlot(uint64_t key) {
+        uint64_t pos = home(key);
+        for (int dist = 0;; dist++, pos = (pos + 1) & mask) {
+            const Slot &s = slots[pos];
+            if (s.index == -1 || s.dist < dist) {
+                return -1;
+            }
+            if (s.key == key) {
+                return (int) pos;
+            }
+        }
+    }
+
+    void insertKey(uint64_t key, int index) {
+        Slot cur = {key, index, 0};
+        uint64_t pos = home(key);
+        while (true) {
+            Slot &s = slots[pos];
+            if (s.index == -1) {
+                s = cur;
+                return;
+            }
+            if (s.dist < cur.dist) {
+                Slot t = s;
+                s = cur;
+                cur = t;
+            }
+            pos = (pos + 1) & mask;
+            cur.dist++;
+        }
+    }
+
+    // backward shift deletion, no tombstones needed
+    void eraseSlot(uint64_t pos) {
+        while (true) {
+            uint64_t nxt = (pos + 1) & mask;
+            if (slots[nxt].index == -1 || slots[nxt].dist == 0) {
+                slots[pos].index = -1;
+                return;
+            }
+            slots[pos] = slots[nxt];
+            slots[pos].dist--;
+            pos = nxt;
+        }
     }
 
 public:
     HashMap(int c) {
         cap = c;
-        a = new DataNode[c];
+        bits = 1;
+        while ((1ll << bits) < 2ll * cap) bits++;
+        mask = (1ull << bits) - 1;
+        slots = new Slot[mask + 1];
+        for (uint64_t i = 0; i <= mask; i++) {
+            slots[i].index = -1;
+        }
+        keys = new uint64_t[cap];
         for (int i = 0; i < cap; i++) {
-            a[i].key1 = -1;
-            a[i].key2 = -1;
+            keys[i] = emptyKey;
         }
-        list = new MultiList(cap, mod);
     }
 
     ~HashMap() {
-        delete list;
-        delete[] a;
+        delete[] slots;
+        delete[] keys;
     }
 
     // return -1 when fail
     int findIndex(int k1, int k2) {
-        int h = hash(k1, k2);
-        int p = list->getFirst(h);
-        while (!list->isHead(p)) {
-            if (a[p].key1 == k1 && a[p].key2 == k2) {
-                return p;
-            }
-            p = list->next(p);
-        }
-        return -1;
+        int pos = findSlot(makeKey(k1, k2));
+        return pos == -1 ? -1 : slots[pos].index;
     }
 
     void replace(int index, int k1, int k2) {
-        int h = hash(k1, k2);
-        list->insertFirst(h, index);
-        a[index].key1 = k1;
-        a[index].key2 = k2;
+        assert(0 <= index && index < cap);
+        erase(index);
+        uint64_t key = makeKey(k1, k2);
+        assert(findSlot(key) == -1);
+        insertKey(key, index);
+        keys[index] = key;
     }
 
     void erase(int index) {
-        list->erase(index);
-        a[index].key1 = -1;
-        a[index].key2 = -1;
+        assert(0 <= index && index < cap);
+        if (keys[index] == emptyKey) {
+            return;
+        }
+        int pos = findSlot(keys[index]);
+        assert(pos != -1);
+        eraseSlot((uint64_t) pos);
+        keys[index] = emptyKey;
     }
 
     void getKeys(int index, int &k1, int &k2) {
-        k1 = a[index].key1;
-        k2 = a[index].key2;
+        if (keys[index] == emptyKey) {
+            k1 = k2 = -1;
+            return;
+        }
+        k1 = (int) (keys[index] >> 32);
+        k2 = (int) (uint32_t) keys[index];
     }
 
 };
@@ -0,0 +1,149 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+
+#include <cstdint>
+#include <cstring>
+
+// The LZ4 block format: a sequence is a token, the literals and a match of
+// at least 4 bytes, 1 to 65535 bytes back. The last 5 bytes are always
+// literals and the last match starts at least 12 bytes before the end.
+// Blocks are small enough here (a page) to skip the frame format.
+class Lz4 {
+    static const int minMatch = 4;
+    static const int lastLiterals = 5;
+    static const int matchLimit = 12;
+    static const int maxOffset = 65535;
+    static const int hashLog = 12;
+
+    static uint32_t read32(const uint8_t *p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static uint32_t hash(uint32_t v) {
+        return (v * 2654435761u) >> (32 - hashLog);
+    }
+
+    // a length of 15 or more goes on in bytes of 255 and a last smaller one
+    static bool putLength(uint8_t *&op, const uint8_t *oend, int len) {
+        for (; len >= 255; len -= 255) {
+            if (op >= oend) return false;
+            *op++ = 255;
+        }
+        if (op >= oend) return false;
+        *op++ = (uint8_t) len;
+        return true;
+    }
+
+    static bool getLength(const uint8_t *&ip, const uint8_t *iend, int &len) {
+        uint8_t b;
+        do {
+            if (ip >= iend) return false;
+            b = *ip++;
+            len += b;
+        } while (b == 255);
+        return true;
+    }
+
+    static bool putSequence(uint8_t *&op, const uint8_t *oend, const uint8_t *lit, int litLen,
+                            int offset, int matchLen) {
+        if (op >= oend) return false;
+        uint8_t *token = op++;
+        *token = (uint8_t) ((litLen < 15 ? litLen : 15) << 4);
+        if (litLen >= 15 && !putLength(op, oend, litLen - 15)) return false;
+        if (oend - op < litLen) return false;
+        memcpy(op, lit, (size_t) litLen);
+        op += litLen;
+        if (matchLen == 0) return true; // the last sequence
+        if (oend - op < 2) return false;
+        *op++ = (uint8_t) offset;
+        *op++ = (uint8_t) (offset >> 8);
+        matchLen -= minMatch;
+        *token |= (uint8_t) (matchLen < 15 ? matchLen : 15);
+        return matchLen < 15 || putLength(op, oend, matchLen - 15);
+    }
+
+public:
+    // Return the size of the compressed block, or -1 if it does not fit
+    // in `cap` bytes.
+    static int compress(const char *src, int len, char *dst, int cap) {
+        auto in = (const uint8_t *) src;
+        const uint8_t *ip = in, *anchor = in, *end = in + len;
+        auto op = (uint8_t *) dst;
+        const uint8_t *oend = op + cap;
+        if (len > matchLimit) {
+            uint32_t table[1 << hashLog];
+            memset(table, 0, sizeof(table));
+            const uint8_t *limit = end - matchLimit;
+            int misses = 0;
+            ip++;
+            while (ip < limit) {
+                uint32_t seq = read32(ip);
+                uint32_t h = hash(seq);
+                const uint8_t *ref = in + table[h];
+                table[h] = (uint32_t) (ip - in);
+                if (ref >= ip || ip - ref > maxOffset || read32(ref) != seq) {
+                    // step faster through data that does not compress
+                    ip += 1 + (misses++ >> 6);
+                    continue;
+                }
+                misses = 0;
+                while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+                    ip--;
+                    ref--;
+                }
+                const uint8_t *p = ip + minMatch, *r = ref + minMatch;
+                while (p < end - lastLiterals && *p == *r) {
+                    p++;
+                    r++;
+                }
+                if (!putSequence(op, oend, anchor, (int) (ip - anchor), (int) (ip - ref), (int) (p - ip))) {
+                    return -1;
+                }
+                ip = anchor = p;
+            }
+        }
+        if (!putSequence(op, oend, anchor, (int) (end - anchor), 0, 0)) return -1;
+        return (int) (op - (uint8_t *) dst);
+    }
+
+    // Return the size of the decompressed data, or -1 if the block is
+    // malformed or would not fit in `cap` bytes.
+    static int decompress(const char *src, int len, char *dst, int cap) {
+        auto ip = (const uint8_t *) src;
+        const uint8_t *iend = ip + len;
+        auto out = (uint8_t *) dst;
+        uint8_t *op = out, *oend = out + cap;
+        for (;;) {
+            if (ip >= iend) return -1;
+            uint8_t token = *ip++;
+            int litLen = token >> 4;
+            if (litLen == 15 && !getLength(ip, iend, litLen)) return -1;
+            if (iend - ip < litLen || oend - op < litLen) return -1;
+            memcpy(op, ip, (size_t) litLen);
+            ip += litLen;
+            op += litLen;
+            if (ip == iend) break;
+            if (iend - ip < 2) return -1;
+            int offset = ip[0] | ip[1] << 8;
+            ip += 2;
+            if (offset == 0 || offset > op - out) return -1;
+            int matchLen = token & 15;
+            if (matchLen == 15 && !getLength(ip, iend, matchLen)) return -1;
+            matchLen += minMatch;
+            if (oend - op < matchLen) return -1;
+            const uint8_t *ref = op - offset;
+            if (offset >= matchLen) {
+                memcpy(op, ref, (size_t) matchLen);
+                op += matchLen;
+            } else {
+                // the match overlaps the bytes it produces
+                while (matchLen--) *op++ = *ref++;
+            }
+        }
+        return (int) (op - out);
+    }
+};
+
+#endif
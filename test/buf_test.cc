@@ -0,0 +1,138 @@
+#include "gtest/gtest.h"
+#include "../src/io/FindReplace.h"
+#include "../src/io/TwoQReplace.h"
+#include "../src/io/ClockProReplace.h"
+#include "../src/util/HashMap.h"
+#include <map>
+#include <random>
+#include <vector>
+
+// drives a policy the same way BufPageManager does
+class PolicySim {
+  ReplacePolicy *policy;
+  std::map<long long, int> resident;
+  std::vector<long long> frameKey;
+
+public:
+  PolicySim(ReplacePolicy *p, int cap) : policy(p), frameKey(cap, -1) {}
+
+  ~PolicySim() { delete policy; }
+
+  // return true if hit
+  bool touch(long long key) {
+    auto it = resident.find(key);
+    if (it != resident.end()) {
+      policy->access(it->second);
+      return true;
+    }
+    int index = policy->find();
+    if (frameKey[index] != -1) resident.erase(frameKey[index]);
+    frameKey[index] = key;
+    resident[key] = index;
+    policy->load(index, key);
+    return false;
+  }
+
+  void free(long long key) {
+    auto it = resident.find(key);
+    if (it == resident.end()) return;
+    frameKey[it->second] = -1;
+    policy->free(it->second);
+    resident.erase(it);
+  }
+
+  bool isResident(long long key) { return resident.count(key) != 0; }
+};
+
+// a small hot set interleaved with a long sequential scan
+double hotHitRatio(ReplacePolicy *p, int cap) {
+  PolicySim sim(p, cap);
+  const int hotSet = cap / 5, scanPerHot = 5;
+  long long scan = 1000000;
+  int hit = 0, tot = 0;
+  for (int round = 0; round < 200; round++) {
+    for (int i = 0; i < hotSet; i++) {
+      bool h = sim.touch(i);
+      if (round >= 100) {
+        hit += h;
+        tot++;
+      }
+      for (int j = 0; j < scanPerHot; j++) sim.touch(scan++);
+    }
+  }
+  return (double) hit / tot;
+}
+
+TEST(BUF_REPLACE, SCAN_RESISTANCE) {
+  const int cap = 100;
+  double lru = hotHitRatio(new FindReplace(cap), cap);
+  double twoQ = hotHitRatio(new TwoQReplace(cap), cap);
+  double clockPro = hotHitRatio(new ClockProReplace(cap), cap);
+  printf("hot set hit ratio: LRU %.3f, 2Q %.3f, CLOCK-Pro %.3f\n", lru, twoQ, clockPro);
+  ASSERT_GT(twoQ, 0.9);
+  ASSERT_GT(clockPro, 0.9);
+  ASSERT_LT(lru, twoQ);
+}
+
+TEST(BUF_REPLACE, FREE_FRAME_REUSED) {
+  const int cap = 16;
+  ReplacePolicy *policies[] = {new FindReplace(cap), new TwoQReplace(cap), new ClockProReplace(cap)};
+  for (auto p : policies) {
+    PolicySim sim(p, cap);
+    for (int i = 0; i < cap; i++) ASSERT_FALSE(sim.touch(i));
+    for (int i = 0; i < cap; i++) ASSERT_TRUE(sim.touch(i));
+    sim.free(3);
+    ASSERT_FALSE(sim.touch(cap));
+    // the freed frame is taken, nothing else is evicted
+    for (int i = 0; i < cap; i++) {
+      if (i != 3) {
+        ASSERT_TRUE(sim.isResident(i));
+      }
+    }
+  }
+}
+
+TEST(BUF_REPLACE, PINNED_FRAME_KEPT) {
+  const int cap = 8;
+  ReplacePolicy *policies[] = {new FindReplace(cap), new TwoQReplace(cap), new ClockProReplace(cap)};
+  for (auto p : policies) {
+    PolicySim sim(p, cap);
+    for (int i = 0; i < cap; i++) sim.touch(i);
+    // frames are handed out in order while the buffer is empty
+    for (int i = 0; i < cap - 1; i++) p->setEvictable(i, false);
+    for (int i = cap; i < 10 * cap; i++) sim.touch(i);
+    for (int i = 0; i < cap - 1; i++) {
+      ASSERT_TRUE(sim.isResident(i));
+    }
+    p->setEvictable(cap - 1, false);
+    ASSERT_EQ(p->find(), -1);
+  }
+}
+
+TEST(BUF_HASH, MATCHES_STD_MAP) {
+  const int cap = 1000;
+  HashMap map(cap);
+  std::map<std::pair<int, int>, int> ref;
+  std::vector<std::pair<int, int>> frameKey(cap, std::make_pair(-1, -1));
+  std::mt19937 rng(0);
+  for (int step = 0; step < 200000; step++) {
+    int index = (int) (rng() % cap);
+    std::pair<int, int> key((int) (rng() % 4), (int) (rng() % 3000));
+    if (rng() % 4 == 0) {
+      map.erase(index);
+      ref.erase(frameKey[index]);
+      frameKey[index] = std::make_pair(-1, -1);
+    } else if (ref.count(key) == 0) {
+      map.replace(index, key.first, key.second);
+      ref.erase(frameKey[index]);
+      ref[key] = index;
+      frameKey[index] = key;
+    }
+    std::pair<int, int> probe((int) (rng() % 4), (int) (rng() % 3000));
+    auto it = ref.find(probe);
+    ASSERT_EQ(map.findIndex(probe.first, probe.second), it == ref.end() ? -1 : it->second);
+    int k1, k2;
+    map.getKeys(index, k1, k2);
+    ASSERT_EQ(std::make_pair(k1, k2), frameKey[index]);
+  }
+}
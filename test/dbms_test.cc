@@ -0,0 +1,52 @@
+#include "gtest/gtest.h"
+#include "../src/backend/Database.h"
+#include "../src/dbms/DBMS.h"
+#include <cstring>
+#include <string>
+
+bool initMode = false;
+
+static expr_node *aggregate(operator_type op, const char *column) {
+    auto *ref = (column_ref *) calloc(1, sizeof(column_ref));
+    ref->column = strdup(column);
+    auto *col = (expr_node *) calloc(1, sizeof(expr_node));
+    col->column = ref;
+    col->node_type = TERM_COLUMN;
+    auto *node = (expr_node *) calloc(1, sizeof(expr_node));
+    node->left = col;
+    node->op = op;
+    node->node_type = TERM_NONE;
+    return node;
+}
+
+TEST(DBMS_TEST, DBMS_TEST_VARCHAR_MIN_MAX) {
+    {
+        Database db;
+        db.create("min_max_test");
+        Table *tb = db.createTable("t");
+        tb->addColumn("name", CT_VARCHAR, 20, false, false, nullptr);
+        tb->addColumn("n", CT_INT, 10, false, false, nullptr);
+        // the smallest and the largest are neither the first nor the last
+        const char *names[] = {"kiwi", "apple", "zucchini", "banana", "mango"};
+        for (int i = 0; i < 5; i++) {
+            tb->clearTempRecord();
+            tb->setTempRecord(1, names[i]);
+            tb->setTempRecord(2, (char *) &i);
+            ASSERT_EQ(tb->insertTempRecord(), "");
+        }
+        db.close();
+    }
+    DBMS *dbms = DBMS::getInstance();
+    dbms->switchToDB("min_max_test");
+    linked_list tables{(void *) "t", nullptr};
+    expr_node *min = aggregate(OPER_MIN, "name"), *max = aggregate(OPER_MAX, "name");
+    // the columns are printed from the last one
+    linked_list second{max, nullptr}, first{min, &second};
+    testing::internal::CaptureStdout();
+    dbms->selectRow(&tables, &first, nullptr);
+    std::string out = testing::internal::GetCapturedStdout();
+    ASSERT_EQ(out, "| 'zucchini' | 'apple' | \n");
+    free_expr(min);
+    free_expr(max);
+    dbms->dropDB("min_max_test");
+}
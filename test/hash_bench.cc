@@ -0,0 +1,57 @@
+#include "../src/util/HashMap.h"
+#include "../src/constants.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Lookup latency of the frame lookup table at different buffer occupancy.
+// Usage: hash_bench [frames]
+
+volatile int sink;
+
+double measure(HashMap &map, const std::vector<std::pair<int, int>> &keys, int rounds) {
+    auto start = std::chrono::steady_clock::now();
+    int acc = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (const auto &k : keys) {
+            acc += map.findIndex(k.first, k.second);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = acc;
+    return std::chrono::duration<double, std::nano>(end - start).count() / ((double) rounds * keys.size());
+}
+
+int main(int argc, char **argv) {
+    int cap = argc > 1 ? atoi(argv[1]) : BUF_CAPACITY;
+    const int lookups = 1 << 20;
+    std::mt19937 rng(2017);
+    printf("%d frames\n", cap);
+    printf("occupancy   hit (ns)   miss (ns)\n");
+    for (int percent : {10, 50, 90}) {
+        HashMap map(cap);
+        int n = (int) ((long long) cap * percent / 100);
+        std::vector<std::pair<int, int>> resident;
+        // pages of a few files, like the tables of a database
+        for (int i = 0; i < n; i++) {
+            int fileID = (int) (rng() % 16), pageID = (int) (rng() % 1000000);
+            if (map.findIndex(fileID, pageID) != -1) {
+                i--;
+                continue;
+            }
+            map.replace(i, fileID, pageID);
+            resident.push_back(std::make_pair(fileID, pageID));
+        }
+        std::vector<std::pair<int, int>> hit, miss;
+        for (int i = 0; i < lookups; i++) {
+            hit.push_back(resident[rng() % resident.size()]);
+            int fileID = (int) (rng() % 16) + 16, pageID = (int) (rng() % 1000000);
+            miss.push_back(std::make_pair(fileID, pageID));
+        }
+        double hitNs = measure(map, hit, 4);
+        double missNs = measure(map, miss, 4);
+        printf("%8d%%  %9.2f  %10.2f\n", percent, hitNs, missNs);
+    }
+    return 0;
+}
@@ -1,50 +1,484 @@
 #include "gtest/gtest.h"
 #include "../src/io/FileManager.h"
 #include "../src/io/BufPageManager.h"
+#include <chrono>
 #include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+// warm-up is off by default, turn it on for BUF_PAGE_MANAGER.WARM_UP
+class WarmUpEnvironment : public testing::Environment {
+  void SetUp() override { BufPageManager::setWarmUp(true); }
+};
+
+static testing::Environment *const warmUpEnvironment = testing::AddGlobalTestEnvironment(new WarmUpEnvironment);
 
 TEST(FILE_MANAGER, CREATE_FILE) {
-  FileManager::getInstance().createFile("helloworld.txt");
+  BufPageManager::getFileManager().createFile("helloworld.txt");
   FILE *file = fopen("helloworld.txt", "r");
   ASSERT_TRUE(file);
   fclose(file);
-  system("rm helloworld.txt");
+  remove("helloworld.txt");
 }
 
 TEST(FILE_MANAGER, FILE_MANAGER_RDWR) {
-  FileManager::getInstance().createFile("helloworld.txt");
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("helloworld.txt");
   char *buf = new char[PAGE_SIZE];
   char *buf2 = new char[PAGE_SIZE];
   for (int i = 0; i < PAGE_SIZE; i++) buf[i] = rand() & 0xFF;
-  int fileId = FileManager::getInstance().openFile("helloworld.txt");
-  ASSERT_EQ(fileId, 0);
-  FileManager::getInstance().writePage(fileId, 15, buf);
+  int fileId = fm.openFile("helloworld.txt");
+  ASSERT_EQ(fm.writePage(fileId, 15, buf), 0);
   memset(buf2, 0, PAGE_SIZE);
-  FileManager::getInstance().readPage(fileId, 15, buf2);
+  ASSERT_EQ(fm.readPage(fileId, 15, buf2), 0);
   ASSERT_EQ(memcmp(buf, buf2, PAGE_SIZE), 0);
-  FileManager::getInstance().closeFile(fileId);
-
-  delete [] buf;
-  delete [] buf2;
-  system("rm helloworld.txt");
-}
-
-TEST(FILE_MENAGER, FILE_MANAGER_MULTIFILE) {
-  FileManager::getInstance().createFile("1.txt");
-  FileManager::getInstance().createFile("2.txt");
-  FileManager::getInstance().createFile("3.txt");
-
-  int fileId = FileManager::getInstance().openFile("1.txt");
-  ASSERT_EQ(fileId, 0);
-  fileId = FileManager::getInstance().openFile("2.txt");
-  ASSERT_EQ(fileId, 1);
-  FileManager::getInstance().closeFile(0);
-  fileId = FileManager::getInstance().openFile("3.txt");
-  ASSERT_EQ(fileId, 0);
-  FileManager::getInstance().closeFile(1);
-  fileId = FileManager::getInstance().openFile("1.txt");
-  ASSERT_EQ(fileId, 1);
-
-  FileManager::getInstance().close();
-  system("rm 1.txt 2.txt 3.txt");
+  // beyond the end of file
+  ASSERT_EQ(fm.readPage(fileId, 16, buf2), -1);
+  fm.closeFile(fileId);
+
+  delete[] buf;
+  delete[] buf2;
+  remove("helloworld.txt");
+}
+
+TEST(FILE_MANAGER, FILE_MANAGER_VECTORED) {
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("vectored.txt");
+  int fileId = fm.openFile("vectored.txt");
+  // two runs longer than one preadv/pwritev and a few single pages
+  std::vector<int> pageIDs;
+  for (int i = 0; i < IO_VEC_MAX + 3; i++) pageIDs.push_back(i);
+  for (int i = 0; i < IO_VEC_MAX * 2; i++) pageIDs.push_back(200 + i);
+  pageIDs.push_back(500);
+  pageIDs.push_back(502);
+  int n = (int) pageIDs.size();
+  std::vector<char> data((size_t) n * PAGE_SIZE), back((size_t) n * PAGE_SIZE);
+  for (auto &c : data) c = (char) (rand() & 0xFF);
+  std::vector<char *> bufs, backBufs;
+  for (int i = 0; i < n; i++) {
+    bufs.push_back(data.data() + (size_t) i * PAGE_SIZE);
+    backBufs.push_back(back.data() + (size_t) i * PAGE_SIZE);
+  }
+  ASSERT_EQ(fm.writePages(fileId, n, pageIDs.data(), bufs.data()), 0);
+  ASSERT_EQ(fm.readPages(fileId, n, pageIDs.data(), backBufs.data()), 0);
+  ASSERT_EQ(memcmp(data.data(), back.data(), data.size()), 0);
+  // single page interface sees the same content
+  ASSERT_EQ(fm.readPage(fileId, 201, backBufs[0]), 0);
+  ASSERT_EQ(memcmp(bufs[IO_VEC_MAX + 4], backBufs[0], PAGE_SIZE), 0);
+  fm.closeFile(fileId);
+  remove("vectored.txt");
+}
+
+TEST(FILE_MANAGER, FILE_MANAGER_DIRECT) {
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("direct.txt");
+  fm.setDirectIO(true);
+  int fileId = fm.openFile("direct.txt");
+  fm.setDirectIO(false);
+  if (!fm.isDirectIO(fileId)) {
+    printf("O_DIRECT is not supported here, testing the usual path\n");
+  }
+  // one buffer from the heap, which may not be aligned, and one aligned
+  std::vector<char> data(PAGE_SIZE + 1), back(PAGE_SIZE + 1);
+  for (auto &c : data) c = (char) (rand() & 0xFF);
+  char *aligned = nullptr;
+  ASSERT_EQ(posix_memalign((void **) &aligned, DIRECT_IO_ALIGN, PAGE_SIZE), 0);
+  memcpy(aligned, data.data() + 1, PAGE_SIZE);
+  char *bufs[2] = {data.data() + 1, aligned};
+  int pageIDs[2] = {3, 4};
+  ASSERT_EQ(fm.writePages(fileId, 2, pageIDs, bufs), 0);
+  ASSERT_EQ(fm.readPage(fileId, 3, back.data() + 1), 0);
+  ASSERT_EQ(memcmp(data.data() + 1, back.data() + 1, PAGE_SIZE), 0);
+  memset(aligned, 0, PAGE_SIZE);
+  ASSERT_EQ(fm.readPage(fileId, 4, aligned), 0);
+  ASSERT_EQ(memcmp(data.data() + 1, aligned, PAGE_SIZE), 0);
+  free(aligned);
+  fm.closeFile(fileId);
+  remove("direct.txt");
+}
+
+TEST(FILE_MANAGER, FILE_MANAGER_COMPRESSED) {
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("compressed.txt", true);
+  int fileId = fm.openFile("compressed.txt");
+  ASSERT_TRUE(fm.isCompressed(fileId));
+  size_t size;
+  ASSERT_EQ(fm.mapFile(fileId, size), nullptr);
+  // pages of records, and one of noise kept as it is
+  const int n = 40;
+  std::vector<char> data((size_t) n * PAGE_SIZE, 0), back((size_t) n * PAGE_SIZE);
+  std::vector<int> pageIDs;
+  std::vector<char *> bufs, backBufs;
+  for (int i = 0; i < n; i++) {
+    char *page = data.data() + (size_t) i * PAGE_SIZE;
+    for (int k = 0; k < 200; k++) sprintf(page + k * 32, "order %d item %d", i, k);
+    if (i == 7) for (int k = 0; k < PAGE_SIZE; k++) page[k] = (char) (rand() & 0xFF);
+    pageIDs.push_back(i);
+    bufs.push_back(page);
+    backBufs.push_back(back.data() + (size_t) i * PAGE_SIZE);
+  }
+  ASSERT_EQ(fm.writePages(fileId, n, pageIDs.data(), bufs.data()), 0);
+  ASSERT_EQ(fm.readPages(fileId, n, pageIDs.data(), backBufs.data()), 0);
+  ASSERT_EQ(memcmp(data.data(), back.data(), data.size()), 0);
+  long long stored, onDisk;
+  fm.getCompressedSize(fileId, stored, onDisk);
+  ASSERT_LT(onDisk, (long long) n * PAGE_SIZE / 3);
+  // a page growing out of its sectors, and one shrinking
+  for (int k = 0; k < PAGE_SIZE; k++) bufs[3][k] = (char) (rand() & 0xFF);
+  ASSERT_EQ(fm.writePage(fileId, 3, bufs[3]), 0);
+  memset(bufs[7], 0, PAGE_SIZE);
+  ASSERT_EQ(fm.writePage(fileId, 7, bufs[7]), 0);
+  ASSERT_EQ(fm.getPageCount(fileId), n);
+  ASSERT_EQ(fm.readPage(fileId, n, backBufs[0]), -1);
+  fm.closeFile(fileId);
+  // the page map is read again
+  fileId = fm.openFile("compressed.txt");
+  ASSERT_TRUE(fm.isCompressed(fileId));
+  ASSERT_EQ(fm.readPages(fileId, n, pageIDs.data(), backBufs.data()), 0);
+  ASSERT_EQ(memcmp(data.data(), back.data(), data.size()), 0);
+  fm.closeFile(fileId);
+  FileManager::removeFile("compressed.txt");
+  std::ifstream map("compressed.txt" PAGE_MAP_SUFFIX);
+  ASSERT_FALSE(map.is_open());
+}
+
+TEST(FILE_MANAGER, FILE_MANAGER_COMPRESSED_REUSE) {
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("reuse.txt", true);
+  int fileId = fm.openFile("reuse.txt");
+  // pages of zeros take one sector each
+  const int n = 2 * PAGE_SECTORS;
+  std::vector<char> zeros(PAGE_SIZE, 0), noise(PAGE_SIZE), back(PAGE_SIZE);
+  for (auto &c : noise) c = (char) (rand() & 0xFF);
+  std::vector<int> pageIDs;
+  std::vector<char *> bufs;
+  for (int i = 0; i < n; i++) {
+    pageIDs.push_back(i);
+    bufs.push_back(zeros.data());
+  }
+  ASSERT_EQ(fm.writePages(fileId, n, pageIDs.data(), bufs.data()), 0);
+  long long stored, onDisk;
+  fm.getCompressedSize(fileId, stored, onDisk);
+  ASSERT_EQ(onDisk, (long long) n * COMPRESS_SECTOR);
+  // the first half moves to the end
+  ASSERT_EQ(fm.writePages(fileId, n / 2, pageIDs.data(), bufs.data()), 0);
+  fm.getCompressedSize(fileId, stored, onDisk);
+  ASSERT_EQ(onDisk, (long long) (n + n / 2) * COMPRESS_SECTOR);
+  // its old sectors are kept until the sync
+  ASSERT_EQ(fm.writePage(fileId, n / 2, zeros.data()), 0);
+  fm.getCompressedSize(fileId, stored, onDisk);
+  ASSERT_EQ(onDisk, (long long) (n + n / 2 + 1) * COMPRESS_SECTOR);
+  // then merge into one free run, where a whole page fits
+  ASSERT_EQ(fm.syncCompressed(), 0);
+  ASSERT_EQ(fm.writePage(fileId, n - 1, noise.data()), 0);
+  fm.getCompressedSize(fileId, stored, onDisk);
+  ASSERT_EQ(onDisk, (long long) (n + n / 2 + 1) * COMPRESS_SECTOR);
+  // rewriting the pages again and again does not grow the file
+  for (int round = 0; round < 10; round++) {
+    ASSERT_EQ(fm.writePages(fileId, n - 1, pageIDs.data(), bufs.data()), 0);
+    ASSERT_EQ(fm.syncCompressed(), 0);
+  }
+  fm.getCompressedSize(fileId, stored, onDisk);
+  ASSERT_LE(onDisk, (long long) 3 * n * COMPRESS_SECTOR);
+  fm.closeFile(fileId);
+  fileId = fm.openFile("reuse.txt");
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(fm.readPage(fileId, i, back.data()), 0);
+    ASSERT_EQ(memcmp(back.data(), i == n - 1 ? noise.data() : zeros.data(), PAGE_SIZE), 0);
+  }
+  fm.closeFile(fileId);
+  FileManager::removeFile("reuse.txt");
+}
+
+TEST(FILE_MANAGER, FILE_MANAGER_MULTIFILE) {
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("1.txt");
+  fm.createFile("2.txt");
+  fm.createFile("3.txt");
+
+  int id1 = fm.openFile("1.txt");
+  int id2 = fm.openFile("2.txt");
+  ASSERT_NE(id1, id2);
+  fm.closeFile(id1);
+  // the temporary ID is reused
+  int id3 = fm.openFile("3.txt");
+  ASSERT_EQ(id3, id1);
+  ASSERT_NE(fm.getFilePermID(id2), fm.getFilePermID(id3));
+  fm.closeFile(id2);
+  fm.closeFile(id3);
+
+  remove("1.txt");
+  remove("2.txt");
+  remove("3.txt");
+}
+
+TEST(BUF_PAGE_MANAGER, WRITE_BACK_ON_CLOSE) {
+  BufPageManager &bpm = BufPageManager::getInstance();
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("buffered.txt");
+  int fileId = fm.openFile("buffered.txt");
+  const int pages = 300;
+  for (int i = pages - 1; i >= 0; i--) {
+    int index = bpm.allocPage(fileId, i);
+    char *page = bpm.access(index);
+    memset(page, i & 0xFF, PAGE_SIZE);
+    bpm.markDirty(index);
+  }
+  bpm.closeFile(fileId);
+  char *buf = new char[PAGE_SIZE];
+  for (int i = 0; i < pages; i++) {
+    ASSERT_EQ(fm.readPage(fileId, i, buf), 0);
+    ASSERT_EQ(buf[0], (char) (i & 0xFF));
+    ASSERT_EQ(buf[PAGE_SIZE - PAGE_CHECKSUM_SIZE - 1], (char) (i & 0xFF));
+    ASSERT_TRUE(BufPageManager::verifyChecksum(buf));
+  }
+  delete[] buf;
+  fm.closeFile(fileId);
+  remove("buffered.txt");
+}
+
+TEST(BUF_PAGE_MANAGER, CHECKPOINT) {
+  BufPageManager &bpm = BufPageManager::getInstance();
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("checkpoint.txt");
+  int fileId = fm.openFile("checkpoint.txt");
+  int dirtyBefore = bpm.getDirtyCount();
+  for (int i = 0; i < 10; i++) {
+    int index = bpm.allocPage(fileId, i);
+    memset(bpm.access(index), 'a' + i, PAGE_SIZE);
+    // only every other page is dirty
+    if (i % 2 == 0) bpm.markDirty(index);
+  }
+  ASSERT_EQ(bpm.getDirtyCount() - dirtyBefore, 5);
+  bpm.checkpoint();
+  ASSERT_EQ(bpm.getDirtyCount(), 0);
+  ASSERT_EQ(fm.getPageCount(fileId), 9);
+  char *buf = new char[PAGE_SIZE];
+  for (int i = 0; i < 10; i += 2) {
+    ASSERT_EQ(fm.readPage(fileId, i, buf), 0);
+    ASSERT_EQ(buf[PAGE_SIZE - PAGE_CHECKSUM_SIZE - 1], (char) ('a' + i));
+  }
+  delete[] buf;
+  // still in the buffer
+  ASSERT_EQ(bpm.access(bpm.getPage(fileId, 4))[0], 'e');
+  bpm.closeFile(fileId);
+  fm.closeFile(fileId);
+  remove("checkpoint.txt");
+}
+
+TEST(BUF_PAGE_MANAGER, STATS) {
+  BufPageManager &bpm = BufPageManager::getInstance();
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("stats.txt");
+  int fileId = fm.openFile("stats.txt");
+  char *buf = new char[PAGE_SIZE];
+  memset(buf, 0, PAGE_SIZE);
+  for (int i = 0; i < 10; i++) {
+    BufPageManager::setChecksum(buf);
+    ASSERT_EQ(fm.writePage(fileId, i * 2 + 1, buf), 0);
+  }
+  delete[] buf;
+  BufferStats before, after;
+  bpm.getStats(before);
+  // pages far apart, nothing is read ahead
+  for (int i = 0; i < 10; i++) bpm.getPage(fileId, i * 2 + 1);
+  for (int i = 0; i < 10; i++) bpm.markDirty(bpm.getPage(fileId, i * 2 + 1));
+  bpm.getStats(after);
+  ASSERT_EQ(after.misses - before.misses, 10);
+  ASSERT_EQ(after.hits - before.hits, 10);
+  ASSERT_EQ(after.reads - before.reads, 10);
+  ASSERT_EQ(after.residentPages[fileId], 10);
+  ASSERT_EQ(after.dirtyPages[fileId], 10);
+  ASSERT_EQ(after.used - before.used, 10);
+  bpm.closeFile(fileId);
+  bpm.getStats(after);
+  ASSERT_EQ(after.residentPages[fileId], 0);
+  ASSERT_EQ(after.dirtyPages[fileId], 0);
+  fm.closeFile(fileId);
+  remove("stats.txt");
+}
+
+TEST(BUF_PAGE_MANAGER, WARM_UP) {
+  BufPageManager &bpm = BufPageManager::getInstance();
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("warm.txt");
+  int fileId = fm.openFile("warm.txt");
+  int permId = fm.getFilePermID(fileId);
+  char *buf = new char[PAGE_SIZE];
+  for (int i = 0; i < 60; i++) {
+    memset(buf, i, PAGE_SIZE);
+    BufPageManager::setChecksum(buf);
+    ASSERT_EQ(fm.writePage(fileId, i, buf), 0);
+  }
+  delete[] buf;
+  for (int i = 1; i < 60; i += 3) bpm.getPage(fileId, i);
+  bpm.closeFile(fileId);
+  fm.closeFile(fileId);
+
+  fileId = fm.openFile("warm.txt");
+  bpm.warmUp(fileId);
+  BufferStats stats;
+  for (int i = 0; i < 500; i++) {
+    bpm.getStats(stats);
+    if (stats.residentPages[fileId] == 20) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(stats.residentPages[fileId], 20);
+  long long misses = stats.misses;
+  for (int i = 1; i < 60; i += 3) {
+    ASSERT_EQ(bpm.access(bpm.getPage(fileId, i))[0], (char) i);
+  }
+  bpm.getStats(stats);
+  ASSERT_EQ(stats.misses, misses);
+
+  // the list is saved for the next run
+  bpm.close();
+  std::ifstream warm(WARM_UP_FILE);
+  int perm, page, count = 0;
+  while (warm >> perm >> page) {
+    if (perm == permId) count++;
+  }
+  ASSERT_EQ(count, 20);
+  fm.closeFile(fileId);
+  remove("warm.txt");
+}
+
+TEST(BUF_PAGE_MANAGER, READ_AHEAD) {
+  BufPageManager &bpm = BufPageManager::getInstance();
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("scanned.txt");
+  int fileId = fm.openFile("scanned.txt");
+  const int pages = 200;
+  char *buf = new char[PAGE_SIZE];
+  for (int i = 0; i < pages; i++) {
+    memset(buf, i & 0xFF, PAGE_SIZE);
+    BufPageManager::setChecksum(buf);
+    ASSERT_EQ(fm.writePage(fileId, i, buf), 0);
+  }
+  delete[] buf;
+  long long before = bpm.getReadAheadHits();
+  for (int i = 0; i < pages; i++) {
+    // like Table::getNext, every record of the page asks for it again
+    for (int j = 0; j < 3; j++) {
+      char *page = bpm.access(bpm.getPage(fileId, i));
+      ASSERT_EQ(page[0], (char) (i & 0xFF));
+      ASSERT_EQ(page[PAGE_SIZE - PAGE_CHECKSUM_SIZE - 1], (char) (i & 0xFF));
+    }
+  }
+  // a scan from page 0 is recognised at once, all the other pages are read
+  // before they are asked for
+  ASSERT_EQ(bpm.getReadAheadHits() - before, pages - 1);
+  bpm.closeFile(fileId);
+  fm.closeFile(fileId);
+  remove("scanned.txt");
+}
+
+TEST(BUF_PAGE_MANAGER, CONCURRENT_FETCH) {
+  BufPageManager &bpm = BufPageManager::getInstance();
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("shared.txt");
+  int fileId = fm.openFile("shared.txt");
+  const int pages = 500, threads = 4;
+  char *buf = new char[PAGE_SIZE];
+  for (int i = 0; i < pages; i++) {
+    memset(buf, i & 0xFF, PAGE_SIZE);
+    BufPageManager::setChecksum(buf);
+    ASSERT_EQ(fm.writePage(fileId, i, buf), 0);
+  }
+  delete[] buf;
+  std::vector<std::thread> workers;
+  std::vector<int> errors(threads, 0);
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      unsigned seed = (unsigned) t;
+      for (int k = 0; k < 5000; k++) {
+        // some threads scan, the others jump around
+        int page = t % 2 == 0 ? k % pages : (int) (rand_r(&seed) % pages);
+        int index = bpm.pinPage(fileId, page);
+        char *data = bpm.access(index);
+        if (data[0] != (char) (page & 0xFF) || data[PAGE_SIZE - PAGE_CHECKSUM_SIZE - 1] != (char) (page & 0xFF)) errors[t]++;
+        bpm.unpin(index);
+      }
+    });
+  }
+  for (auto &w : workers) w.join();
+  for (int t = 0; t < threads; t++) ASSERT_EQ(errors[t], 0);
+  bpm.closeFile(fileId);
+  fm.closeFile(fileId);
+  remove("shared.txt");
+}
+
+TEST(BUF_PAGE_MANAGER, ALL_PINNED) {
+  BufPageManager &bpm = BufPageManager::getInstance();
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("pinned.txt");
+  int fileId = fm.openFile("pinned.txt");
+  // pin new pages until the shard of one of them is full
+  std::vector<int> pinned;
+  int pageID = 0;
+  bool full = false;
+  while (pageID <= bpm.getCapacity()) {
+    try {
+      pinned.push_back(bpm.allocPage(fileId, pageID, false, true));
+    } catch (const BufferFullError &) {
+      full = true;
+      break;
+    }
+    pageID++;
+  }
+  ASSERT_TRUE(full);
+  ASSERT_LE((int) pinned.size(), bpm.getCapacity());
+  ASSERT_THROW(bpm.pinPage(fileId, pageID), BufferFullError);
+  ASSERT_THROW(bpm.getPage(fileId, pageID), BufferFullError);
+  for (int index : pinned) bpm.unpin(index);
+  int index = bpm.allocPage(fileId, pageID, false, true);
+  memset(bpm.access(index), 'p', PAGE_SIZE);
+  bpm.markDirty(index);
+  bpm.unpin(index);
+  bpm.closeFile(fileId);
+  char *buf = new char[PAGE_SIZE];
+  ASSERT_EQ(fm.readPage(fileId, pageID, buf), 0);
+  ASSERT_EQ(buf[0], 'p');
+  delete[] buf;
+  fm.closeFile(fileId);
+  remove("pinned.txt");
+}
+
+TEST(BUF_PAGE_MANAGER, CHECKSUM) {
+  ASSERT_EQ(Crc32c::compute("123456789", 9), 0xE3069283u);
+  BufPageManager &bpm = BufPageManager::getInstance();
+  FileManager &fm = BufPageManager::getFileManager();
+  fm.createFile("torn.txt");
+  int fileId = fm.openFile("torn.txt");
+  for (int i = 0; i < 4; i++) {
+    int index = bpm.allocPage(fileId, i);
+    memset(bpm.access(index), 'a' + i, PAGE_SIZE);
+    bpm.markDirty(index);
+  }
+  bpm.closeFile(fileId);
+  // only the first half of page 2 made it to the disk
+  char *buf = new char[PAGE_SIZE];
+  ASSERT_EQ(fm.readPage(fileId, 2, buf), 0);
+  ASSERT_TRUE(BufPageManager::verifyChecksum(buf));
+  memset(buf + PAGE_SIZE / 2, 'z', PAGE_SIZE / 2);
+  ASSERT_EQ(fm.writePage(fileId, 2, buf), 0);
+  delete[] buf;
+  BufferStats before, after;
+  bpm.getStats(before);
+  for (int i = 3; i >= 0; i--) {
+    if (i == 2) ASSERT_THROW(bpm.getPage(fileId, i), ChecksumError);
+    else ASSERT_EQ(bpm.access(bpm.getPage(fileId, i))[0], 'a' + i);
+  }
+  // the bad page is not kept in the buffer, it is read again
+  ASSERT_THROW(bpm.allocPage(fileId, 2, true), ChecksumError);
+  BufPageManager::setBestEffortReads(true);
+  ASSERT_EQ(bpm.access(bpm.getPage(fileId, 2))[PAGE_SIZE / 2], 'z');
+  BufPageManager::setBestEffortReads(false);
+  bpm.getStats(after);
+  ASSERT_EQ(after.checksumPages - before.checksumPages, 6);
+  ASSERT_EQ(after.checksumFailures - before.checksumFailures, 3);
+  bpm.closeFile(fileId, false);
+  fm.closeFile(fileId);
+  remove("torn.txt");
 }
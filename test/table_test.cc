@@ -1,11 +1,684 @@
 #include "gtest/gtest.h"
 #include "../src/backend/Table.h"
+#include "../src/backend/Database.h"
+#include "../src/io/BufPageManager.h"
+#include "../src/io/PageMap.h"
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+bool initMode = false;
 
 TEST(TABLE_TEST, TABLE_TEST_SIZE) {
-    printf("TableHead has size %d\n", (int) sizeof(TableHead));
-    ASSERT_LE(sizeof(TableHead), PAGE_SIZE);
+    // a narrow table has a footer bit for each record it can hold
+    Database db;
+    db.create("size_test");
+    Table *tb = db.createTable("t");
+    tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+    ASSERT_EQ(tb->getRecordBytes(), 12);
+    int perPage = tb->recordsPerPage();
+    printf("%d records of 12 bytes in a page\n", perPage);
+    ASSERT_GT(perPage, 512);
+    ASSERT_LE(perPage * 12 + (perPage + 31) / 32 * 4, PAGE_SIZE - PAGE_CHECKSUM_SIZE);
+    for (int i = 0; i < perPage * 2; i++) {
+        tb->clearTempRecord();
+        tb->setTempRecord(1, (char *) &i);
+        ASSERT_EQ(tb->insertTempRecord(), "");
+    }
+    int cnt = 0;
+    RID_t last = (RID_t) -1;
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid), cnt++) last = rid;
+    ASSERT_EQ(cnt, perPage * 2);
+    // page 1 is the free-space map
+    ASSERT_EQ(last / PAGE_SIZE, 3u);
+    db.drop();
+}
+
+TEST(TABLE_TEST, TABLE_TEST_WIDE) {
+    // more columns than fit in a byte, the index on one past them
+    const int columns = 400, rows = 300;
+    TableLayout layouts[] = {TL_ROW, TL_SLOTTED, TL_PAX};
+    for (TableLayout layout : layouts) {
+        {
+            Database db;
+            db.create("wide_test");
+            Table *tb = db.createTable("t", layout);
+            for (int c = 1; c <= columns; c++) {
+                // long names, so that the catalog takes more than one page
+                std::string name = "column_with_a_rather_long_name_" + std::to_string(c);
+                int def = -c;
+                tb->addColumn(name.c_str(), CT_INT, 10, c == columns, c % 50 == 0, (char *) &def);
+            }
+            tb->createIndex(300);
+            for (int i = 0; i < rows; i++) {
+                tb->clearTempRecord();
+                for (int c = 1; c <= columns; c++) {
+                    int v = i * 1000 + c;
+                    // the first record takes the defaults
+                    if (c % 50 == 0 && i == 0) continue;
+                    if (c % 50 == 0 || (i + c) % 7) tb->setTempRecord(c, (char *) &v);
+                    else tb->setTempRecordNull(c);
+                }
+                ASSERT_EQ(tb->insertTempRecord(), "");
+            }
+            tb->clearTempRecord();
+            tb->setTempRecordNull(columns);
+            ASSERT_NE(tb->insertTempRecord(), "");
+            db.close();
+        }
+        Database db;
+        db.open("wide_test");
+        Table *tb = db.getTableByName("t");
+        ASSERT_EQ(tb->getColumnCount(), columns + 1);
+        ASSERT_EQ(tb->getColumnID("column_with_a_rather_long_name_137"), 137);
+        ASSERT_EQ(tb->getColumnID("column_with_a_rather_long_name_391"), 391);
+        ASSERT_TRUE(tb->hasIndex(300));
+        ASSERT_FALSE(tb->hasIndex(150));
+        ASSERT_TRUE(tb->isPrimary(0));
+        int cnt = 0;
+        for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid), cnt++) {
+            int i = *(const int *) tb->view(rid, 50).data / 1000;
+            for (int c = 1; c <= columns; c++) {
+                ColumnView v = tb->view(rid, c);
+                if (c % 50 == 0 || (i + c) % 7) {
+                    ASSERT_FALSE(v.isNull);
+                    ASSERT_EQ(*(const int *) v.data, c % 50 == 0 && i == 0 ? -c : i * 1000 + c);
+                } else {
+                    ASSERT_TRUE(v.isNull);
+                }
+            }
+        }
+        ASSERT_EQ(cnt, rows);
+        int key = 7 * 1000 + 300;
+        RID_t rid = tb->selectIndexLowerBoundEqual(300, (char *) &key);
+        ASSERT_NE(rid, (RID_t) -1);
+        ASSERT_EQ(*(const int *) tb->view(rid, 300).data, key);
+        db.drop();
+    }
+}
+
+TEST(TABLE_TEST, TABLE_TEST_WIDE_CHECK) {
+    const int columns = 200;
+    {
+        Database db;
+        db.create("wide_check_test");
+        Table *tb = db.createTable("t");
+        for (int c = 1; c <= columns; c++) {
+            std::string name = "column_with_a_rather_long_name_" + std::to_string(c);
+            tb->addColumn(name.c_str(), c == columns ? CT_VARCHAR : CT_INT, 20, false, false, nullptr);
+        }
+        // column 120 IN (1, 2), the last column IN ('yes', 'no')
+        for (int v = 1; v <= 2; v++) tb->addCheck(120, OP_EQ, (char *) &v, RE_OR);
+        tb->addCheck(columns, OP_EQ, (char *) "yes", RE_OR);
+        tb->addCheck(columns, OP_EQ, (char *) "no", RE_OR);
+        db.close();
+    }
+    Database db;
+    db.open("wide_check_test");
+    Table *tb = db.getTableByName("t");
+    for (int v = 0; v <= 3; v++) {
+        tb->clearTempRecord();
+        tb->setTempRecord(120, (char *) &v);
+        tb->setTempRecord(columns, "no");
+        ASSERT_EQ(tb->insertTempRecord().empty(), v == 1 || v == 2);
+    }
+    int v = 2;
+    tb->clearTempRecord();
+    tb->setTempRecord(120, (char *) &v);
+    tb->setTempRecord(columns, "maybe");
+    // the error lists both values of the last column
+    std::string err = tb->insertTempRecord();
+    ASSERT_NE(err.find("column_with_a_rather_long_name_200"), std::string::npos);
+    ASSERT_NE(err.find("'yes'"), std::string::npos);
+    ASSERT_NE(err.find("'no'"), std::string::npos);
+    int cnt = 0;
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) cnt++;
+    ASSERT_EQ(cnt, 2);
+    db.drop();
 }
 
 TEST(TABLE_TEST, TABLE_TEST_CREATE) {
 
 }
+
+TEST(TABLE_TEST, TABLE_TEST_READ_ONLY) {
+    const int rows = 3000;
+    {
+        Database db;
+        db.create("read_only_test");
+        Table *tb = db.createTable("t");
+        tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+        for (int i = 0; i < rows; i++) {
+            tb->clearTempRecord();
+            tb->setTempRecord(1, (char *) &i);
+            ASSERT_EQ(tb->insertTempRecord(), "");
+        }
+        db.close();
+    }
+    {
+        Database db;
+        db.open("read_only_test", true);
+        ASSERT_TRUE(db.isReadOnly());
+        Table *tb = db.getTableByName("t");
+        ASSERT_TRUE(tb->isReadOnly());
+        long long sum = 0;
+        int cnt = 0;
+        for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid), cnt++) {
+            sum += *(int *) (tb->getRecordTempPtr(rid) + tb->getColumnOffset(1));
+        }
+        ASSERT_EQ(cnt, rows);
+        ASSERT_EQ(sum, (long long) rows * (rows - 1) / 2);
+        tb->clearTempRecord();
+        tb->setTempRecord(1, (char *) &cnt);
+        ASSERT_NE(tb->insertTempRecord(), "");
+        db.close();
+    }
+    Database db;
+    db.open("read_only_test");
+    ASSERT_FALSE(db.isReadOnly());
+    int cnt = 0;
+    Table *tb = db.getTableByName("t");
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) cnt++;
+    ASSERT_EQ(cnt, rows);
+    db.drop();
+}
+
+TEST(TABLE_TEST, TABLE_TEST_DAMAGED) {
+    const int rows = 3000;
+    {
+        Database db;
+        db.create("damaged_test");
+        Table *tb = db.createTable("t");
+        tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+        for (int i = 0; i < rows; i++) {
+            tb->clearTempRecord();
+            tb->setTempRecord(1, (char *) &i);
+            ASSERT_EQ(tb->insertTempRecord(), "");
+        }
+        db.close();
+    }
+    const char *file = "damaged_test.t.table";
+    std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekg(0, std::ios::end);
+    std::streamoff size = f.tellg();
+    // a byte of the last page goes bad on the disk
+    f.seekg(size - PAGE_SIZE + 100);
+    char c = (char) f.get();
+    f.seekp(size - PAGE_SIZE + 100);
+    f.put((char) ~c);
+    f.flush();
+    // read in place from the mapped file, then through the buffer
+    for (bool readOnly : {true, false}) {
+        Database db;
+        db.open("damaged_test", readOnly);
+        Table *tb = db.getTableByName("t");
+        int cnt = 0;
+        auto scan = [&] {
+            for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) cnt++;
+        };
+        ASSERT_THROW(scan(), ChecksumError);
+        ASSERT_GT(cnt, 0);
+        ASSERT_LT(cnt, rows);
+        db.close();
+    }
+    // a file written before the checksums starts with the column count
+    int16_t old[2] = {2, 1};
+    f.seekp(0);
+    f.write((const char *) old, sizeof(old));
+    f.close();
+    Database db;
+    ASSERT_THROW(db.open("damaged_test"), TableFormatError);
+    ASSERT_FALSE(db.isOpen());
+    remove("damaged_test.db");
+    remove(file);
+}
+
+TEST(TABLE_TEST, TABLE_TEST_COMPRESSED) {
+    const int rows = 3000;
+    {
+        Database db;
+        db.create("compressed_test");
+        Table *tb = db.createTable("t", TL_ROW, true);
+        ASSERT_TRUE(tb->isCompressed());
+        tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+        tb->addColumn("b", CT_VARCHAR, 100, false, false, nullptr);
+        for (int i = 0; i < rows; i++) {
+            std::string s = "shipped " + std::to_string(i % 10);
+            tb->clearTempRecord();
+            tb->setTempRecord(1, (char *) &i);
+            tb->setTempRecord(2, s.c_str());
+            ASSERT_EQ(tb->insertTempRecord(), "");
+        }
+        db.close();
+    }
+    std::ifstream file("compressed_test.t.table", std::ios::ate | std::ios::binary);
+    ASSERT_TRUE(file.is_open());
+    Database db;
+    db.open("compressed_test", true);
+    Table *tb = db.getTableByName("t");
+    ASSERT_TRUE(tb->isCompressed());
+    // a quarter of the records or less on the disk
+    ASSERT_LT((long long) file.tellg(), (long long) rows * tb->getRecordBytes() / 4);
+    long long sum = 0;
+    int cnt = 0;
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid), cnt++) {
+        int a = *(int *) (tb->getRecordTempPtr(rid) + tb->getColumnOffset(1));
+        ColumnView b = tb->view(rid, 2);
+        ASSERT_EQ(std::string(b.data, b.len), "shipped " + std::to_string(a % 10));
+        sum += a;
+    }
+    ASSERT_EQ(cnt, rows);
+    ASSERT_EQ(sum, (long long) rows * (rows - 1) / 2);
+    db.close();
+    Database dropped;
+    dropped.open("compressed_test");
+    dropped.drop();
+    std::ifstream map("compressed_test.t.table" PAGE_MAP_SUFFIX);
+    ASSERT_FALSE(map.is_open());
+}
+
+TEST(TABLE_TEST, TABLE_TEST_SLOTTED) {
+    const int rows = 2000;
+    Database db;
+    db.create("slotted_test");
+    Table *tb = db.createTable("t", TL_SLOTTED);
+    tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+    tb->addColumn("b", CT_VARCHAR, 200, false, false, nullptr);
+    for (int i = 0; i < rows; i++) {
+        std::string s(i % 10, 'x');
+        tb->clearTempRecord();
+        tb->setTempRecord(1, (char *) &i);
+        tb->setTempRecord(2, s.c_str());
+        ASSERT_EQ(tb->insertTempRecord(), "");
+    }
+    // 16 bytes and the string a record instead of 216 bytes, 8 pages instead of 55
+    std::vector<RID_t> rids;
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) rids.push_back(rid);
+    ASSERT_EQ((int) rids.size(), rows);
+    ASSERT_LE(rids.back() / PAGE_SIZE, 8u);
+    // grow every record of the first page, some of them move but keep their RID
+    std::string longer(200, 'y');
+    for (RID_t rid : rids) {
+        if (rid / PAGE_SIZE != 1) break;
+        ASSERT_EQ(tb->modifyRecord(rid, 2, (char *) longer.c_str()), "");
+    }
+    for (int i = 0; i < rows; i++) {
+        char *a = tb->select(rids[i], 1);
+        char *b = tb->select(rids[i], 2);
+        ASSERT_EQ(*(int *) a, i);
+        ASSERT_EQ(std::string(b), rids[i] / PAGE_SIZE == 1 ? longer : std::string(i % 10, 'x'));
+        delete[] a;
+        delete[] b;
+    }
+    int cnt = 0;
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) cnt++;
+    ASSERT_EQ(cnt, rows);
+    for (int i = 0; i < rows; i += 2) tb->dropRecord(rids[i]);
+    cnt = 0;
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) cnt++;
+    ASSERT_EQ(cnt, rows / 2);
+    db.drop();
+}
+
+TEST(TABLE_TEST, TABLE_TEST_PAX) {
+    const int rows = 3000;
+    Database db;
+    db.create("pax_test");
+    Table *tb = db.createTable("t", TL_PAX);
+    tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+    tb->addColumn("b", CT_VARCHAR, 20, false, false, nullptr);
+    for (int i = 0; i < rows; i++) {
+        std::string s = std::to_string(i);
+        tb->clearTempRecord();
+        tb->setTempRecord(1, (char *) &i);
+        if (i % 3) tb->setTempRecord(2, s.c_str()); else tb->setTempRecordNull(2);
+        ASSERT_EQ(tb->insertTempRecord(), "");
+    }
+    // the records are not in the order of insertion, find them by `a`
+    std::vector<RID_t> rids(rows, (RID_t) -1);
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) {
+        char *a = tb->select(rid, 1);
+        rids[*(int *) a] = rid;
+        delete[] a;
+    }
+    ASSERT_EQ(std::count(rids.begin(), rids.end(), (RID_t) -1), 0);
+    ASSERT_EQ(tb->modifyRecordNull(rids[1], 2), "");
+    ASSERT_EQ(tb->modifyRecord(rids[2], 2, (char *) "changed"), "");
+    for (int i = 0; i < rows; i += 2) tb->dropRecord(rids[i]);
+    // the column vectors agree with select
+    ColumnVector a, b;
+    long long sum = 0;
+    int cnt = 0;
+    for (int p = 0, q = 0; tb->scanColumn(1, p, a);) {
+        ASSERT_TRUE(tb->scanColumn(2, q, b));
+        ASSERT_EQ(a.count, b.count);
+        for (int i = 0; i < a.count; i++) {
+            int v = *(int *) &a.values[i * a.width];
+            ASSERT_FALSE(a.isNull[i]);
+            ASSERT_EQ(a.rids[i], rids[v]);
+            ASSERT_EQ(b.rids[i], rids[v]);
+            char *s = tb->select(rids[v], 2);
+            ASSERT_EQ(b.isNull[i] != 0, s == nullptr);
+            if (s) {
+                ASSERT_EQ(std::string(&b.values[i * b.width]), std::string(s));
+            }
+            delete[] s;
+            sum += v;
+            cnt++;
+        }
+    }
+    ASSERT_EQ(cnt, rows / 2);
+    ASSERT_EQ(sum, (long long) rows * rows / 4);
+    char *s = tb->select(rids[1], 2);
+    ASSERT_EQ(s, nullptr);
+    db.drop();
+}
+
+TEST(TABLE_TEST, TABLE_TEST_FREE_SPACE) {
+    Database db;
+    db.create("fsm_test");
+    Table *tb = db.createTable("t");
+    tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+    tb->addColumn("b", CT_VARCHAR, 1000, false, false, nullptr);
+    int perPage = tb->recordsPerPage();
+    for (int i = 0; i < perPage * 3; i++) {
+        tb->clearTempRecord();
+        tb->setTempRecord(1, (char *) &i);
+        ASSERT_EQ(tb->insertTempRecord(), "");
+    }
+    // page 1 is the free-space map, the records fill pages 2 to 4
+    std::vector<RID_t> rids;
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) rids.push_back(rid);
+    ASSERT_EQ((int) rids.size(), perPage * 3);
+    ASSERT_EQ(rids.front() / PAGE_SIZE, 2u);
+    ASSERT_EQ(rids.back() / PAGE_SIZE, 4u);
+    // the room left by a delete is taken before a new page is added
+    tb->dropRecord(rids[1]);
+    int v = -1;
+    tb->clearTempRecord();
+    tb->setTempRecord(1, (char *) &v);
+    ASSERT_EQ(tb->insertTempRecord(), "");
+    RID_t last = (RID_t) -1;
+    for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) last = rid;
+    ASSERT_EQ(last, rids.back());
+    char *a = tb->select(rids[1], 1);
+    ASSERT_EQ(*(int *) a, -1);
+    delete[] a;
+    db.drop();
+}
+
+TEST(TABLE_TEST, TABLE_TEST_SCAN_PAGE) {
+    const int rows = 5000;
+    TableLayout layouts[] = {TL_ROW, TL_SLOTTED, TL_PAX};
+    for (TableLayout layout : layouts) {
+        Database db;
+        db.create("scan_page_test");
+        Table *tb = db.createTable("t", layout);
+        tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+        for (int i = 0; i < rows; i++) {
+            tb->clearTempRecord();
+            tb->setTempRecord(1, (char *) &i);
+            ASSERT_EQ(tb->insertTempRecord(), "");
+        }
+        // whole words of the footers empty, single records left, a page emptied
+        std::vector<RID_t> all, dropped;
+        for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) all.push_back(rid);
+        for (size_t k = 0; k < all.size(); k++) {
+            int i = *(const int *) tb->view(all[k], 1).data;
+            if ((i / 40) % 3 == 1 || (i % 7 && i / 1000 == 2) || all[k] / PAGE_SIZE == all[0] / PAGE_SIZE) {
+                dropped.push_back(all[k]);
+            }
+        }
+        for (RID_t rid : dropped) tb->dropRecord(rid);
+        std::vector<RID_t> byRecord, byPage, page;
+        for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) byRecord.push_back(rid);
+        for (int pageID = 0; tb->scanPage(pageID, page);) {
+            ASSERT_FALSE(page.empty());
+            for (RID_t rid : page) ASSERT_EQ(rid / PAGE_SIZE, page[0] / PAGE_SIZE);
+            byPage.insert(byPage.end(), page.begin(), page.end());
+        }
+        ASSERT_EQ((int) byRecord.size(), rows - (int) dropped.size());
+        ASSERT_EQ(byPage, byRecord);
+        db.drop();
+    }
+}
+
+TEST(TABLE_TEST, TABLE_TEST_SCAN_BATCH) {
+    const int rows = 5000;
+    TableLayout layouts[] = {TL_ROW, TL_SLOTTED, TL_PAX};
+    for (TableLayout layout : layouts) {
+        Database db;
+        db.create("scan_batch_test");
+        Table *tb = db.createTable("t", layout);
+        tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+        tb->addColumn("b", CT_VARCHAR, 100, false, false, nullptr);
+        tb->addColumn("c", CT_FLOAT, 10, false, false, nullptr);
+        for (int i = 0; i < rows; i++) {
+            std::string s(i % 20, 'a' + i % 26);
+            float f = i * 0.5f;
+            tb->clearTempRecord();
+            tb->setTempRecord(1, (char *) &i);
+            if (i % 3) tb->setTempRecord(2, s.c_str()); else tb->setTempRecordNull(2);
+            tb->setTempRecord(3, (char *) &f);
+            ASSERT_EQ(tb->insertTempRecord(), "");
+        }
+        std::vector<RID_t> all;
+        for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) all.push_back(rid);
+        for (size_t k = 0; k < all.size(); k += 5) tb->dropRecord(all[k]);
+        // grown out of their pages in a TL_SLOTTED table
+        std::string longer(90, 'z');
+        for (size_t k = 1; k < all.size(); k += 50) {
+            ASSERT_EQ(tb->modifyRecord(all[k], 2, (char *) longer.c_str()), "");
+        }
+        std::vector<RID_t> byRecord, byBatch;
+        for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) byRecord.push_back(rid);
+        RecordBatch batch;
+        std::vector<int> cols = {2, 1, 3};
+        for (RID_t last = (RID_t) -1; tb->scanBatch(cols, last, batch);) {
+            ASSERT_EQ(last, batch.rids[batch.count - 1]);
+            // only the last batch is not full
+            if (byBatch.size() + batch.count < byRecord.size()) {
+                ASSERT_EQ(batch.count, BATCH_ROWS);
+            }
+            for (int i = 0; i < batch.count; i++) {
+                RID_t rid = batch.rids[i];
+                int a = batch.columns[1].ints()[i];
+                ASSERT_FALSE(batch.columns[1].isNull(i));
+                ASSERT_EQ(a, *(const int *) tb->view(rid, 1).data);
+                ASSERT_EQ(batch.columns[2].floats()[i], a * 0.5f);
+                ColumnView b = tb->view(rid, 2);
+                ASSERT_EQ(batch.columns[0].isNull(i), b.isNull);
+                if (!b.isNull) {
+                    ASSERT_EQ(std::string(batch.columns[0].value(i)), std::string(b.data, b.len));
+                }
+                byBatch.push_back(rid);
+            }
+        }
+        ASSERT_EQ(byBatch, byRecord);
+        db.drop();
+    }
+}
+
+TEST(TABLE_TEST, TABLE_TEST_VACUUM) {
+    const int rows = 3000;
+    TableLayout layouts[] = {TL_ROW, TL_SLOTTED, TL_PAX, TL_ROW};
+    for (int k = 0; k < 4; k++) {
+        // the last one compressed
+        bool compressed = k == 3;
+        {
+            Database db;
+            db.create("vacuum_test");
+            Table *tb = db.createTable("t", layouts[k], compressed);
+            tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+            tb->addColumn("b", CT_VARCHAR, 30, false, false, nullptr);
+            tb->createIndex(1);
+            for (int i = 0; i < rows; i++) {
+                std::string s(i % 30, 'a' + i % 26);
+                tb->clearTempRecord();
+                tb->setTempRecord(1, (char *) &i);
+                tb->setTempRecord(2, s.c_str());
+                ASSERT_EQ(tb->insertTempRecord(), "");
+            }
+            std::vector<RID_t> rids;
+            for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) {
+                if (*(const int *) tb->view(rid, 1).data % 10) rids.push_back(rid);
+            }
+            for (RID_t rid : rids) tb->dropRecord(rid);
+            db.close();
+        }
+        std::ifstream before("vacuum_test.t.table", std::ios::ate | std::ios::binary);
+        ASSERT_TRUE(before.is_open());
+        {
+            Database db;
+            db.open("vacuum_test");
+            ASSERT_GT(db.getTableByName("t")->vacuum(), 0);
+            db.close();
+        }
+        std::ifstream after("vacuum_test.t.table", std::ios::ate | std::ios::binary);
+        ASSERT_LT((long long) after.tellg(), (long long) before.tellg() / 2);
+        Database db;
+        db.open("vacuum_test");
+        Table *tb = db.getTableByName("t");
+        int cnt = 0;
+        for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid), cnt++) {
+            ASSERT_EQ(*(const RID_t *) tb->view(rid, 0).data, rid);
+            int i = *(const int *) tb->view(rid, 1).data;
+            ASSERT_EQ(i % 10, 0);
+            ColumnView b = tb->view(rid, 2);
+            ASSERT_EQ(std::string(b.data, b.len), std::string(i % 30, 'a' + i % 26));
+        }
+        ASSERT_EQ(cnt, rows / 10);
+        // the index entries point to the new places
+        for (int i = 0; i < rows; i += 10) {
+            RID_t rid = tb->selectIndexLowerBoundEqual(1, (char *) &i);
+            ASSERT_NE(rid, (RID_t) -1);
+            ASSERT_EQ(*(const int *) tb->view(rid, 1).data, i);
+        }
+        int v = rows;
+        tb->clearTempRecord();
+        tb->setTempRecord(1, (char *) &v);
+        ASSERT_EQ(tb->insertTempRecord(), "");
+        ASSERT_NE(tb->selectIndexLowerBoundEqual(1, (char *) &v), (RID_t) -1);
+        db.drop();
+    }
+}
+
+TEST(TABLE_TEST, TABLE_TEST_VIEW) {
+    TableLayout layouts[] = {TL_ROW, TL_SLOTTED, TL_PAX};
+    for (TableLayout layout : layouts) {
+        Database db;
+        db.create("view_test");
+        Table *tb = db.createTable("t", layout);
+        tb->addColumn("a", CT_INT, 10, false, false, nullptr);
+        tb->addColumn("b", CT_VARCHAR, 30, false, false, nullptr);
+        for (int i = 0; i < 500; i++) {
+            std::string s(i % 30, 'a' + i % 26);
+            tb->clearTempRecord();
+            tb->setTempRecord(1, (char *) &i);
+            if (i % 4) tb->setTempRecord(2, s.c_str()); else tb->setTempRecordNull(2);
+            ASSERT_EQ(tb->insertTempRecord(), "");
+        }
+        int cnt = 0;
+        for (RID_t rid = tb->getNext((RID_t) -1); rid != (RID_t) -1; rid = tb->getNext(rid)) {
+            ColumnView a = tb->view(rid, 1);
+            ASSERT_FALSE(a.isNull);
+            ASSERT_EQ(a.len, 4);
+            int i = *(const int *) a.data;
+            ColumnView b = tb->view(rid, 2);
+            ASSERT_EQ(b.isNull, i % 4 == 0);
+            if (!b.isNull) {
+                ASSERT_EQ(std::string(b.data, b.len), std::string(i % 30, 'a' + i % 26));
+                ASSERT_EQ(b.data[b.len], '\0');
+            }
+            cnt++;
+        }
+        ASSERT_EQ(cnt, 500);
+        db.drop();
+    }
+}
+
+TEST(TABLE_TEST, TABLE_TEST_BATCH) {
+    const int rows = 5000;
+    Database db;
+    db.create("batch_test");
+    Table *tb = db.createTable("t");
+    tb->addColumn("a", CT_INT, 10, true, false, nullptr);
+    tb->addColumn("b", CT_INT, 10, false, false, nullptr);
+    tb->setPrimary(1);
+    tb->createIndex(1);
+    tb->createIndex(2);
+    tb->beginBatch();
+    for (int i = 0; i < rows; i++) {
+        int a = (i * 7919) % rows, b = rows - a;
+        tb->clearTempRecord();
+        tb->setTempRecord(1, (char *) &a);
+        tb->setTempRecord(2, (char *) &b);
+        ASSERT_EQ(tb->insertTempRecord(), "");
+    }
+    // the primary key is still checked within the batch
+    int dup = 42;
+    tb->setTempRecord(1, (char *) &dup);
+    ASSERT_NE(tb->insertTempRecord(), "");
+    tb->endBatch();
+    // both indexes hold every record, in order
+    int cnt = 0, last = -1;
+    for (RID_t rid = tb->selectIndexLowerBoundNull(2); rid != (RID_t) -1; rid = tb->selectIndexNext(2)) {
+        char *b = tb->select(rid, 2);
+        ASSERT_GT(*(int *) b, last);
+        last = *(int *) b;
+        delete[] b;
+        cnt++;
+    }
+    ASSERT_EQ(cnt, rows);
+    int key = 1234;
+    RID_t rid = tb->selectIndexLowerBoundEqual(1, (char *) &key);
+    ASSERT_NE(rid, (RID_t) -1);
+    char *b = tb->select(rid, 2);
+    ASSERT_EQ(*(int *) b, rows - key);
+    delete[] b;
+    db.drop();
+}
+
+TEST(TABLE_TEST, TABLE_TEST_INDEX_ORDER) {
+    // equal fast keys, the values themselves are compared
+    const int rows = 3000;
+    Database db;
+    db.create("index_order_test");
+    Table *tb = db.createTable("t");
+    tb->addColumn("s", CT_VARCHAR, 20, false, false, nullptr);
+    tb->addColumn("f", CT_FLOAT, 10, false, false, nullptr);
+    tb->createIndex(1);
+    tb->createIndex(2);
+    for (int i = 0; i < rows; i++) {
+        int k = (i * 7919) % rows;
+        char s[16];
+        sprintf(s, "key%05d", k);
+        float f = (float) k / rows;
+        tb->clearTempRecord();
+        tb->setTempRecord(1, s);
+        tb->setTempRecord(2, (char *) &f);
+        ASSERT_EQ(tb->insertTempRecord(), "");
+    }
+    std::string lastS;
+    int cnt = 0;
+    for (RID_t rid = tb->selectIndexLowerBoundNull(1); rid != (RID_t) -1; rid = tb->selectIndexNext(1), cnt++) {
+        std::string s = tb->view(rid, 1).data;
+        ASSERT_LT(lastS, s);
+        lastS = s;
+    }
+    ASSERT_EQ(cnt, rows);
+    float lastF = -1;
+    cnt = 0;
+    for (RID_t rid = tb->selectIndexLowerBoundNull(2); rid != (RID_t) -1; rid = tb->selectIndexNext(2), cnt++) {
+        float f = *(const float *) tb->view(rid, 2).data;
+        ASSERT_LT(lastF, f);
+        lastF = f;
+    }
+    ASSERT_EQ(cnt, rows);
+    float key = (float) 1234 / rows;
+    RID_t rid = tb->selectIndexLowerBoundEqual(2, (char *) &key);
+    ASSERT_NE(rid, (RID_t) -1);
+    ASSERT_STREQ(tb->view(rid, 1).data, "key01234");
+    db.drop();
+}